@@ -0,0 +1,416 @@
+/*
+ * PinballBotBench.cpp
+ *
+ * Measures the hot paths of the agent, the simulation and the policy files and writes the results as json,
+ * one object per benchmark with the time and the heap allocations per operation. Benchmarks that depend on
+ * the state table run once per StateTable::Type, so the backends can be compared side by side.
+ *
+ * Built by the pinballbot-bench target of CMakeLists.txt, without SDL as a headless build leaving out the renderer.
+ * Run it from the repository root (opensans.ttf is loaded from the working directory):
+ *   ./build/pinballbot-bench [results.json] [largest table size]
+ * The renderer draws offscreen with the software renderer, so no display is needed. The policy files are written to the working directory
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "PinballBot.h"
+#include "agent/Agent.h"
+#include "agent/State.h"
+#include "agent/StateTable.h"
+#include "action/Action.h"
+#include "sim/Simulation.h"
+#include "sim/VecSimulation.h"
+#include "stats/AllocationCounter.h"
+
+#ifndef PINBALLBOT_HEADLESS
+#include "sim/Renderer.h"
+#endif
+
+//PinballBot.cpp isn't linked, the agent reads and writes its files through these
+const std::string					PinballBot::POLICIES_FILE			= "bench-policies.bin";
+const std::string					PinballBot::POLICIES_DELTA_FILE		= "bench-policies.bin.delta";
+const std::string					PinballBot::POLICIES_CSV_FILE		= "bench-policies.csv";
+
+static const float					TIME_STEP			= 1.0f / 60.0f; //PinballBot::TIME_STEP
+static const uint64_t				SEED				= 42;
+static const int					ACTION_COUNT		= 4;
+static const int					QUERIES				= 1 << 16;
+static const int					REWARD_INTERVAL		= 64;	//every how many decisions a reward arrives
+static const size_t					DEFAULT_MAX_STATES	= 10000000;
+
+//keeps the optimizer from dropping the benchmarked loops
+static volatile int sink;
+
+/**
+ * An action that does nothing, so think() is measured without a simulation
+ */
+class BenchAction : public Action{
+
+	private:
+
+		std::string uid;
+
+	public:
+
+		BenchAction(int ordinal) : uid("BENCH_" + std::to_string(ordinal)){}
+
+		void run(){}
+
+		const char* getUID(){
+			return uid.c_str();
+		}
+};
+
+/**
+ * One line of the results
+ */
+struct Result{
+	std::string				name;
+	std::string				backend;
+	size_t					size;
+	long					operations;
+	double					nanosecondsPerOperation;
+	double					allocationsPerOperation;
+};
+
+static std::vector<Result>	results;
+static std::string			resultsFile			= "bench-results.json";
+
+/**
+ * Measures the time and the allocations of a number of operations
+ */
+class Measurement{
+
+	private:
+
+		std::chrono::steady_clock::time_point	started;
+		unsigned long long						allocations;
+
+	public:
+
+		Measurement() : started(std::chrono::steady_clock::now()), allocations(AllocationCounter::getAllocations()){}
+
+		/**
+		 * Stops measuring, adds the result and rewrites the results file, so the results survive a crashing benchmark
+		 */
+		void stop(const std::string &name, const std::string &backend, size_t size, long operations){
+			double				nanoseconds		= std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+			unsigned long long	allocated		= AllocationCounter::getAllocations() - allocations;
+
+			Result result = {name, backend, size, operations, nanoseconds / operations, (double) allocated / operations};
+			results.push_back(result);
+
+			printf("%-24s %-8s %10lu: %12.1f ns/op %10.2f allocations/op\n", name.c_str(), backend.c_str(), size,
+					result.nanosecondsPerOperation, result.allocationsPerOperation);
+
+			FILE *file = fopen(resultsFile.c_str(), "w");
+
+			if(file == NULL){
+				printf("ERROR: Couldn't write %s\n", resultsFile.c_str());
+				return;
+			}
+
+			fprintf(file, "[\n");
+
+			for(size_t i=0;i<results.size();i++){
+				fprintf(file, "\t{\"name\": \"%s\", \"backend\": \"%s\", \"size\": %lu, \"operations\": %ld, \"ns_per_op\": %.3f, \"allocations_per_op\": %.4f}%s\n",
+						results[i].name.c_str(), results[i].backend.c_str(), results[i].size, results[i].operations,
+						results[i].nanosecondsPerOperation, results[i].allocationsPerOperation, i + 1 < results.size() ? "," : "");
+			}
+
+			fprintf(file, "]\n");
+			fclose(file);
+		}
+};
+
+/**
+ * Returns the i-th state of the capture frame grid, the velocity changes fastest.
+ * Indices beyond the grid continue below it, where the dense index falls back to the hash index
+ */
+static State getState(size_t i, const StateTable::Grid &grid){
+	size_t velocities	= grid.maxVelocity - grid.minVelocity + 1;
+	size_t columns		= grid.maxPositionX - grid.minPositionX + 1;
+
+	return State(
+			grid.minPositionX + (int) ((i / velocities / velocities) % columns),
+			grid.minPositionY + (int) (i / velocities / velocities / columns),
+			grid.minVelocity + (int) ((i / velocities) % velocities),
+			grid.minVelocity + (int) (i % velocities)
+	);
+}
+
+static void removePolicyFiles(){
+	std::remove(PinballBot::POLICIES_FILE.c_str());
+	std::remove(PinballBot::POLICIES_DELTA_FILE.c_str());
+}
+
+/**
+ * Fills the table of an agent with the first size states of the grid
+ */
+static void fillTable(Agent &agent, size_t size, const StateTable::Grid &grid, std::default_random_engine &generator){
+	std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+
+	agent.states.reserve(size);
+
+	for(size_t i=0;i<size;i++){
+		int index = agent.states.findOrInsert(getState(i, grid));
+
+		for(int a=0;a<ACTION_COUNT;a++){
+			agent.states.setValue(index, a, values(generator));
+		}
+	}
+}
+
+static void benchmarkThink(const std::vector<Action*> &actions, StateTable::Type type, size_t size){
+	StateTable::Grid					grid		= Simulation::getCaptureFrameGrid(true);
+	std::default_random_engine			generator(SEED);
+	std::uniform_int_distribution<size_t>	pick(0, size - 1);
+
+	removePolicyFiles();
+
+	Agent agent(Agent::DEFAULT_STATES_TO_BACKPORT, Agent::DEFAULT_VALUE_ADJUST_FRACTION, Agent::DEFAULT_EPSILON, actions,
+			Agent::DEFAULT_STEPS_UNTIL_MIN_EPSILON, Agent::DEFAULT_DYNAMIC_EPSILON, type, grid, TraceBuffer::DEFAULT_DECAY, SEED);
+
+	fillTable(agent, size, grid, generator);
+
+	//drawn up front, so only think() is measured
+	std::vector<State> queries;
+
+	for(int i=0;i<QUERIES;i++){
+		queries.push_back(getState(pick(generator), grid));
+	}
+
+	std::vector<float>	noRewards;
+	std::vector<float>	reward(1, 1.0f);
+	long				operations	= std::max(QUERIES * 4L, (long) std::min(size, (size_t) 1 << 20));
+
+	//warms the traces up
+	for(int i=0;i<QUERIES;i++){
+		agent.think(queries[i], noRewards, i);
+	}
+
+	Measurement measurement;
+
+	for(long i=0;i<operations;i++){
+		agent.think(queries[i % QUERIES], i % REWARD_INTERVAL == 0 ? reward : noRewards, QUERIES + i);
+	}
+
+	measurement.stop("agent_think", StateTable::getTypeName(type), size, operations);
+}
+
+static void benchmarkStateLookup(size_t size){
+	StateTable::Grid					grid		= Simulation::getCaptureFrameGrid(true);
+	std::default_random_engine			generator(SEED);
+	std::uniform_int_distribution<size_t>	pick(0, size - 1);
+
+	std::vector<State> sorted;
+
+	for(size_t i=0;i<size;i++){
+		sorted.push_back(getState(i, grid));
+	}
+
+	std::sort(sorted.begin(), sorted.end());
+
+	std::vector<State> queries;
+
+	for(int i=0;i<QUERIES;i++){
+		queries.push_back(getState(pick(generator), grid));
+	}
+
+	long operations	= QUERIES * 16L;
+	int checksum	= 0;
+
+	Measurement compare;
+
+	for(long i=0;i<operations;i++){
+		const State &lhs = queries[i % QUERIES];
+		const State &rhs = queries[(i + 1) % QUERIES];
+
+		checksum += (lhs < rhs) + (lhs == rhs);
+	}
+
+	compare.stop("state_compare", "-", QUERIES, operations);
+
+	Measurement lowerBound;
+
+	for(long i=0;i<operations;i++){
+		checksum += std::lower_bound(sorted.begin(), sorted.end(), queries[i % QUERIES]) - sorted.begin();
+	}
+
+	lowerBound.stop("state_lower_bound", "sorted", size, operations);
+
+	for(int t=0;t<2;t++){
+		StateTable::Type	type	= (StateTable::Type) t;
+		StateTable			table(ACTION_COUNT, type, grid);
+
+		table.reserve(size);
+
+		for(size_t i=0;i<size;i++){
+			table.findOrInsert(sorted[i]);
+		}
+
+		Measurement find;
+
+		for(long i=0;i<operations;i++){
+			checksum += table.find(queries[i % QUERIES]);
+		}
+
+		find.stop("state_table_find", StateTable::getTypeName(type), size, operations);
+	}
+
+	sink = checksum;
+}
+
+static void benchmarkSimulation(){
+	std::default_random_engine			generator(SEED);
+	long								operations	= 1 << 17;
+
+	{
+		Simulation							sim(false, SEED);
+		std::vector<Action*>				actions		= ActionsSim::actionsAvailable(sim);
+		std::uniform_int_distribution<int>	pick(0, actions.size() - 1);
+
+		Measurement measurement;
+
+		for(long i=0;i<operations;i++){
+			//about as often as the agent decides
+			if(i % 8 == 0){
+				actions[pick(generator)]->run();
+			}
+
+			sim.step(TIME_STEP);
+		}
+
+		measurement.stop("simulation_step", "-", 1, operations);
+
+		for(int a=0;a<actions.size();a++){
+			delete actions[a];
+		}
+	}
+
+	const int count = 64;
+
+	VecSimulation						sims(count, false, SEED);
+	std::vector<int>					actionIndices(count, VecSimulation::HOLD_ACTION);
+	std::uniform_int_distribution<int>	pick(0, sims.getActionCount() - 1);
+
+	Measurement measurement;
+
+	for(long i=0;i<operations / count;i++){
+		for(int s=0;s<count;s++){
+			actionIndices[s] = (i + s) % 8 == 0 ? pick(generator) : VecSimulation::HOLD_ACTION;
+		}
+
+		sims.step(actionIndices.data(), TIME_STEP);
+	}
+
+	measurement.stop("vec_simulation_step", "-", count, operations / count * count);
+}
+
+static void benchmarkPolicies(const std::vector<Action*> &actions, StateTable::Type type, size_t size){
+	StateTable::Grid					grid		= Simulation::getCaptureFrameGrid(true);
+	std::default_random_engine			generator(SEED);
+
+	removePolicyFiles();
+
+	Agent agent(Agent::DEFAULT_STATES_TO_BACKPORT, Agent::DEFAULT_VALUE_ADJUST_FRACTION, Agent::DEFAULT_EPSILON, actions,
+			Agent::DEFAULT_STEPS_UNTIL_MIN_EPSILON, Agent::DEFAULT_DYNAMIC_EPSILON, type, grid, TraceBuffer::DEFAULT_DECAY, SEED);
+
+	fillTable(agent, size, grid, generator);
+
+	//the first save compacts everything into a new base
+	Measurement save;
+
+	agent.savePoliciesToFile();
+	agent.flushPolicies();
+
+	save.stop("save_policies", StateTable::getTypeName(type), size, 1);
+
+	Measurement load;
+
+	agent.loadPolicyFromFile();
+
+	load.stop("load_policies", StateTable::getTypeName(type), size, 1);
+
+	removePolicyFiles();
+}
+
+#ifndef PINBALLBOT_HEADLESS
+static void benchmarkRenderer(){
+	Simulation				sim(false, SEED);
+	Renderer				renderer(320, 640, sim.getWorld(), true);
+	long					operations	= 1 << 10;
+
+	Measurement measurement;
+
+	for(long i=0;i<operations;i++){
+		sim.step(TIME_STEP);
+		renderer.render(std::to_string(i).c_str());
+	}
+
+	measurement.stop("renderer_render", "-", 1, operations);
+}
+#endif
+
+int main(int argc, char** argv){
+	size_t maxStates = DEFAULT_MAX_STATES;
+
+	if(argc > 1){
+		resultsFile = argv[1];
+	}
+
+	if(argc > 2){
+		maxStates = std::strtoull(argv[2], NULL, 10);
+	}
+
+	std::vector<Action*> actions;
+
+	for(int a=0;a<ACTION_COUNT;a++){
+		actions.push_back(new BenchAction(a));
+	}
+
+	std::vector<size_t> sizes = {1000, 1000000, 10000000};
+
+	for(size_t size : sizes){
+		if(size > maxStates){
+			continue;
+		}
+
+		for(int t=0;t<2;t++){
+			benchmarkThink(actions, (StateTable::Type) t, size);
+		}
+	}
+
+	benchmarkStateLookup(std::min(maxStates, (size_t) 1000000));
+
+	benchmarkSimulation();
+
+	for(size_t size : {(size_t) 100000, (size_t) 1000000}){
+		if(size > maxStates){
+			continue;
+		}
+
+		for(int t=0;t<2;t++){
+			benchmarkPolicies(actions, (StateTable::Type) t, size);
+		}
+	}
+
+#ifndef PINBALLBOT_HEADLESS
+	benchmarkRenderer();
+#endif
+
+	for(int a=0;a<ACTION_COUNT;a++){
+		delete actions[a];
+	}
+
+	printf("Wrote %lu results to %s\n", results.size(), resultsFile.c_str());
+
+	return 0;
+}
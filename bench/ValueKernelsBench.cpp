@@ -0,0 +1,231 @@
+/*
+ * ValueKernelsBench.cpp
+ *
+ * Compares the value kernels with the map based action selection they replaced, and TraceBuffer::backup() on a
+ * StateTable with the map based backup
+ *
+ * Built by the value-kernels-bench target of CMakeLists.txt, which needs only the Box2D headers. Build it once per
+ * instruction set to compare them, the second time with -DPINBALLBOT_AVX2=ON:
+ *   cmake -S . -B build && cmake --build build --target value-kernels-bench && ./build/value-kernels-bench
+ */
+
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+
+#include "agent/ValueKernels.h"
+#include "agent/State.h"
+#include "agent/StateTable.h"
+#include "agent/TraceBuffer.h"
+
+static const int	ROWS				= 1 << 16;
+static const int	ITERATIONS			= 1 << 20;
+static const int	STATES_TO_BACKPORT	= 40;
+static const int	BACKUP_ROUNDS		= 5;
+static const float	FRACTION			= 0.1f;
+
+//keeps the optimizer from dropping the benchmarked loops
+static volatile int sink;
+
+//stands in for the actions of the game, only its address is used as the key of the maps
+struct MapAction{
+	int ordinal;
+};
+
+/**
+ * The action selection as it was: a std::map per state, a vector of the tied actions and a copy of both
+ */
+static MapAction* mapGreedy(std::map<MapAction*, float> values, const std::vector<MapAction*> &actions, std::default_random_engine &generator){
+	float					maxValue = 0;
+	std::vector<MapAction*>	maxActions;
+
+	for(int i=0;i<actions.size();i++){
+		float tmpValue = values[actions[i]];
+
+		if(tmpValue > maxValue){
+			maxValue = tmpValue;
+
+			maxActions.clear();
+			maxActions.push_back(actions[i]);
+		}else if(tmpValue == maxValue){
+			maxActions.push_back(actions[i]);
+		}
+	}
+
+	if(maxActions.size() == 1){
+		return maxActions[0];
+	}
+
+	return maxActions[std::uniform_int_distribution<int>(0, maxActions.size() - 1)(generator)];
+}
+
+static int kernelGreedy(const float *values, int count, std::default_random_engine &generator){
+	float	maxValue	= ValueKernels::max(values, count, 0.0f);
+	int		maxActions	= ValueKernels::countEqual(values, count, maxValue);
+	int		pick		= maxActions <= 1 ? 0 : std::uniform_int_distribution<int>(0, maxActions - 1)(generator);
+
+	return ValueKernels::findEqual(values, count, maxValue, pick);
+}
+
+static double nanosecondsSince(std::chrono::steady_clock::time_point start, long operations){
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / operations;
+}
+
+static void benchmarkGreedy(int actionCount){
+	std::default_random_engine					generator(42);
+	std::uniform_int_distribution<int>			valueDistribution(0, 4);
+
+	std::vector<MapAction>						actionStorage(actionCount);
+	std::vector<MapAction*>						actions(actionCount);
+	std::vector<std::map<MapAction*, float>>	mapRows(ROWS / 16);
+	std::vector<float>							flatRows((size_t)(ROWS / 16) * actionCount);
+
+	for(int a=0;a<actionCount;a++){
+		actionStorage[a].ordinal	= a;
+		actions[a]					= &actionStorage[a];
+	}
+
+	for(int r=0;r<mapRows.size();r++){
+		for(int a=0;a<actionCount;a++){
+			float value = valueDistribution(generator) * 0.25f;
+
+			mapRows[r][actions[a]]						= value;
+			flatRows[(size_t) r * actionCount + a]		= value;
+		}
+	}
+
+	int iterations = ITERATIONS / 4;
+	int checksum = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int i=0;i<iterations;i++){
+		checksum += mapGreedy(mapRows[i % mapRows.size()], actions, generator)->ordinal;
+	}
+	double mapNs = nanosecondsSince(start, iterations);
+
+	start = std::chrono::steady_clock::now();
+	for(int i=0;i<iterations;i++){
+		checksum += kernelGreedy(&flatRows[(size_t)(i % mapRows.size()) * actionCount], actionCount, generator);
+	}
+	double kernelNs = nanosecondsSince(start, iterations);
+
+	sink = checksum;
+
+	printf("greedy   %3d actions: map %8.1f ns/op, kernel %8.1f ns/op, speedup %5.1fx\n", actionCount, mapNs, kernelNs, mapNs / kernelNs);
+}
+
+static void benchmarkBackup(int actionCount){
+	std::default_random_engine					generator(42);
+	std::uniform_int_distribution<int>			rowDistribution(0, ROWS - 1);
+	std::uniform_int_distribution<int>			actionDistribution(0, actionCount - 1);
+
+	std::vector<MapAction>						actionStorage(actionCount);
+	std::vector<std::map<MapAction*, float>>	mapRows(ROWS);
+	StateTable									table(actionCount);
+
+	for(int a=0;a<actionCount;a++){
+		actionStorage[a].ordinal = a;
+	}
+
+	table.reserve(ROWS);
+
+	for(int r=0;r<ROWS;r++){
+		int index = table.findOrInsert(State(r % 256, r / 256, 0, 0));
+
+		for(int a=0;a<actionCount;a++){
+			mapRows[index][&actionStorage[a]] = 0.5f;
+			table.setValue(index, a, 0.5f);
+		}
+	}
+
+	//the ball often stays inside of the same state, so every traced action is repeated a few times
+	std::deque<std::pair<int, MapAction*>>	mapTrace;
+	std::pair<int, int>						traced;
+	TraceBuffer								traces(STATES_TO_BACKPORT);
+
+	for(int i=0;i<STATES_TO_BACKPORT;i++){
+		if(i % 4 == 0){
+			traced = std::make_pair(rowDistribution(generator), actionDistribution(generator));
+		}
+
+		mapTrace.push_back(std::make_pair(traced.first, &actionStorage[traced.second]));
+		traces.push(traced.first, traced.second);
+	}
+
+	std::vector<float> rewards(1, 1.0f);
+
+	int		iterations	= ITERATIONS / 16;
+	double	mapNs		= 0;
+	double	kernelNs	= 0;
+
+	//the fastest of a few alternating rounds is compared, so a busy machine doesn't decide the result
+	for(int round=0;round<BACKUP_ROUNDS;round++){
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(int i=0;i<iterations;i++){
+			for(int t=0;t<mapTrace.size();t++){
+				float value = mapRows[mapTrace[t].first][mapTrace[t].second];
+
+				for(int r=0;r<rewards.size();r++){
+					value = value + FRACTION * (rewards[r] - value);
+				}
+
+				value = value + FRACTION * (0.5f - value);
+
+				mapRows[mapTrace[t].first][mapTrace[t].second] = value;
+			}
+		}
+		double ns = nanosecondsSince(start, iterations);
+		mapNs = round == 0 ? ns : std::min(mapNs, ns);
+
+		//what the trainer runs on every decision with a reward
+		start = std::chrono::steady_clock::now();
+		for(int i=0;i<iterations;i++){
+			traces.backup(table, rewards.data(), rewards.size(), FRACTION, 0.5f);
+		}
+		ns = nanosecondsSince(start, iterations);
+		kernelNs = round == 0 ? ns : std::min(kernelNs, ns);
+	}
+
+	sink = (int) table.getValue(traces[0].first, traces[0].second);
+
+	printf("backup   %3d actions: map %8.1f ns/op, traces %8.1f ns/op, speedup %5.1fx (%d traced actions, 1 reward)\n",
+			actionCount, mapNs, kernelNs, mapNs / kernelNs, STATES_TO_BACKPORT);
+}
+
+static void benchmarkAffine(){
+	std::vector<float> values(1024, 0.5f), scales(1024, 0.9f), offsets(1024, 0.05f);
+
+	int iterations = ITERATIONS / 64;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int i=0;i<iterations;i++){
+		ValueKernels::affine(values.data(), scales.data(), offsets.data(), values.size());
+	}
+	double kernelNs = nanosecondsSince(start, (long) iterations * values.size());
+
+	sink = (int) values[0];
+
+	printf("affine   contiguous: %.3f ns/value\n", kernelNs);
+}
+
+int main(){
+	printf("Value kernels compiled for %s\n", ValueKernels::getInstructionSet());
+
+	int actionCounts[] = {4, 16, 64};
+
+	for(int actionCount : actionCounts){
+		benchmarkGreedy(actionCount);
+	}
+
+	for(int actionCount : actionCounts){
+		benchmarkBackup(actionCount);
+	}
+
+	benchmarkAffine();
+
+	return 0;
+}
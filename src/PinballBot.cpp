@@ -14,28 +14,46 @@
 #include <numeric>
 #include <ctime>
 #include <cmath>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
 
 #include <boost/program_options.hpp>
 
+#ifndef PINBALLBOT_HEADLESS
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_main.h>
+#endif
 
 #include "PinballBot.h"
 
 #include "action/ActionsSim.cpp"
 
 #include "sim/Simulation.h"
+
+#ifndef PINBALLBOT_HEADLESS
 #include "sim/Renderer.h"
+#include "sim/Recorder.h"
+#endif
 
 #include "agent/Agent.h"
 #include "agent/State.h"
+#include "agent/StateTable.h"
+#include "agent/PolicyFile.h"
 
 #include "stats/StatsLogger.h"
+#include "stats/AllocationCounter.h"
 
 const bool						PinballBot::DEFAULT_AGENT_ENABLED			= true;
 const bool						PinballBot::DEFAULT_DYNAMIC_STEP_INCREMENT	= true;
 
+#ifdef PINBALLBOT_HEADLESS
+const bool						PinballBot::DEFAULT_RENDER					= false;
+#else
 const bool						PinballBot::DEFAULT_RENDER					= true;
+#endif
 const float						PinballBot::FPS								= 60.0f;
 const float						PinballBot::TIME_STEP						= 1.0f / FPS;
 const float						PinballBot::TICK_INTERVAL					= 1000.0f / FPS;
@@ -53,49 +71,120 @@ const unsigned long long		PinballBot::OUTSIDE_CF_UNTIL_RESPAWN		= 1800;//1 step
 
 const unsigned long long		PinballBot::DEFAULT_QUIT_STEP				= 5184000;
 
+const std::string				PinballBot::DEFAULT_TABLE					= "sparse";
+
+const int						PinballBot::DEFAULT_WORKERS					= 1;
+const unsigned int				PinballBot::WORKER_POLL_INTERVAL			= 100;//ms
+
+const int						PinballBot::DEFAULT_ACTION_REPEAT			= 1;
+const bool						PinballBot::DEFAULT_ADAPTIVE_ACTION_REPEAT	= false;
+const float						PinballBot::ACTION_REPEAT_HALF_SPEED		= 1.0f;//m/s
+
+const bool						PinballBot::DEFAULT_DECIDE_ON_CHANGE		= false;
+
 const std::string				PinballBot::STATS_FILE						= "stats.csv";
-const std::string				PinballBot::POLICIES_FILE					= "policies.csv";
+const std::string				PinballBot::TIMING_FILE						= "timing.csv";
+const std::string				PinballBot::POLICIES_FILE					= "policies.bin";
+const std::string				PinballBot::POLICIES_DELTA_FILE				= "policies.delta";
+const std::string				PinballBot::POLICIES_CSV_FILE				= "policies.csv";
+
+const std::string				PinballBot::DEFAULT_POLICY_ENCODING			= "float32";
+
+const size_t					PinballBot::DEFAULT_MAX_TABLE_MEMORY		= 0;//MB, unlimited
+
+const std::string				PinballBot::DEFAULT_RECORD_FORMAT			= "png";
+const unsigned long long		PinballBot::DEFAULT_RECORD_INTERVAL			= 1;//every step, FPS frames per simulated second
 
 PinballBot::PinballBot(
 		bool agentEnabled, bool dynamicStepIncrement, bool render,
-		unsigned long long baseStatsInterval, unsigned int maxBaseStatsMultiple
+		unsigned long long baseStatsInterval, unsigned int maxBaseStatsMultiple,
+		PolicyFile::Encoding policyEncoding, size_t maxTableMemory, uint64_t seed,
+		int actionRepeat, bool adaptiveActionRepeat, bool decideOnChange
 		) :
-		statsLogger(), rewardsCollected(0, 0.0f),
+		statsLogger(), timingLogger(), rewardsCollected(0, 0.0f),
 		agentEnabled(agentEnabled), render(render), dynamicStepIncrement(dynamicStepIncrement),
-		baseStatsInterval(baseStatsInterval), maxBaseStatsMultiple(maxBaseStatsMultiple){
+		baseStatsInterval(baseStatsInterval), maxBaseStatsMultiple(maxBaseStatsMultiple),
+		policyEncoding(policyEncoding), maxTableMemory(maxTableMemory), seed(seed),
+		actionRepeat(actionRepeat), adaptiveActionRepeat(adaptiveActionRepeat), decideOnChange(decideOnChange){
 
-	KEYS							= SDL_GetKeyboardState(NULL);
+#ifndef PINBALLBOT_HEADLESS
+	KEYS							= render ? SDL_GetKeyboardState(NULL) : nullptr;
 
 	pause							= false;
 	quit							= false;
 
+	leftFlipperPressed				= false;
+	rightFlipperPressed				= false;
+	saveRequested					= false;
+
 	nextTime						= 0;
 
+	renderer						= nullptr;
+
+	recorder						= nullptr;
+	recordFormat					= Recorder::PNG;
+	recordInterval					= DEFAULT_RECORD_INTERVAL;
+#endif
+
 	steps							= 0;
 	statsRewardsCollected			= 0;
-	timeLastLog						= std::time(nullptr);
+	timeLastLog						= std::chrono::steady_clock::now();
 	gameOvers						= 0;
+	statsDecisions					= 0;
+	statsDecisionAllocations		= 0;
+	statsStates						= 0;
 
 	stepStartedBeingOutsideCF		= 0;
 	nextStatsLog					= baseStatsInterval;
 	deltaStatsLog					= baseStatsInterval;
 
 	rlAgent							= nullptr;
-	renderer						= nullptr;
 
 	std::string per = " (per " + std::to_string(baseStatsInterval) + " )";
 
+	//only what a run with the same seed and one worker repeats exactly, so two such runs write the same STATS_FILE
 	statsLogger.registerLoggingColumn("STEPS",					std::bind(&PinballBot::logSteps, this));
-	statsLogger.registerLoggingColumn("TIME",					std::bind(&PinballBot::logTime, this));
 	statsLogger.registerLoggingColumn("AMOUNT_OF_STATES",		std::bind(&PinballBot::logAmountOfStates, this));
 	statsLogger.registerLoggingColumn("EPSILON",				std::bind(&PinballBot::logEpsilon, this));
 	statsLogger.registerLoggingColumn("REWARDS_COLLECTED"+per,	std::bind(&PinballBot::logRewardsCollected, this));
 	statsLogger.registerLoggingColumn("GAMEOVERS"+per,			std::bind(&PinballBot::logGameOvers, this));
 	statsLogger.registerLoggingColumn("SCORE"+per,				std::bind(&PinballBot::logScore, this));
+	statsLogger.registerLoggingColumn("STEPS_PER_DECISION",		std::bind(&PinballBot::logStepsPerDecision, this));
+
+	//everything depending on the clock or on the timing of the background threads, at the same steps as STATS_FILE.
+	//Allocations depend on it as well: a row written while the policy writer still holds its chunk copies the chunk
+	timingLogger.registerLoggingColumn("STEPS",					std::bind(&PinballBot::logSteps, this));
+	timingLogger.registerLoggingColumn("TIME",					std::bind(&PinballBot::logTime, this));
+	timingLogger.registerLoggingColumn("TIME_PER_STEP_US",		std::bind(&PinballBot::logAverageTimePerLoop, this));
+	timingLogger.registerLoggingColumn("ALLOCATIONS_PER_DECISION",	std::bind(&PinballBot::logAllocationsPerDecision, this));
+	timingLogger.registerLoggingColumn("SNAPSHOT_PAUSE_MS",		std::bind(&PinballBot::logSnapshotPause, this));
+	timingLogger.registerLoggingColumn("POLICY_WRITE_MS",		std::bind(&PinballBot::logPolicyWriteDuration, this));
+	timingLogger.registerLoggingColumn("POLICY_CHECKPOINT_ROWS",	std::bind(&PinballBot::logPolicyCheckpointRows, this));
+	timingLogger.registerLoggingColumn("STATES_EVICTED",		std::bind(&PinballBot::logStatesEvicted, this));
+	timingLogger.registerLoggingColumn("EVICTION_SLICE_MS",		std::bind(&PinballBot::logEvictionSlice, this));
+
+#ifndef PINBALLBOT_HEADLESS
+	timingLogger.registerLoggingColumn("RECORDED_FRAMES",		std::bind(&PinballBot::logRecordedFrames, this));
+	timingLogger.registerLoggingColumn("DROPPED_FRAMES",		std::bind(&PinballBot::logDroppedFrames, this));
+	timingLogger.registerLoggingColumn("RECORD_MS",				std::bind(&PinballBot::logRecordDuration, this));
+	timingLogger.registerLoggingColumn("ENCODE_MS",				std::bind(&PinballBot::logEncodeDuration, this));
+#endif
+
+#ifndef PINBALLBOT_NO_PROFILER
+	for(int p=0;p<PhaseProfiler::PHASE_COUNT;p++){
+		std::string name = PhaseProfiler::PHASE_NAMES[p];
+
+		timingLogger.registerLoggingColumn(name + "_P50_US",		[this, p]{ return std::to_string(phaseSummaries[p].p50); });
+		timingLogger.registerLoggingColumn(name + "_P99_US",		[this, p]{ return std::to_string(phaseSummaries[p].p99); });
+		timingLogger.registerLoggingColumn(name + "_MAX_US",		[this, p]{ return std::to_string(phaseSummaries[p].max); });
+	}
+#endif
 
 	statsLogger.initLog(STATS_FILE);
+	timingLogger.initLog(TIMING_FILE);
 }
 
+#ifndef PINBALLBOT_HEADLESS
 Uint32 PinballBot::timeLeft() {
     Uint32 now = SDL_GetTicks();
 
@@ -111,27 +200,17 @@ void PinballBot::capFramerate() {
 	nextTime += TICK_INTERVAL;
 }
 
-void PinballBot::handleKeys(Simulation &sim, SDL_Event &e){
+void PinballBot::handleKeys(SDL_Event &e){
 
 	while( SDL_PollEvent( &e ) != 0){
 		if( e.type == SDL_QUIT ){
 			quit = true;
 		}
 
+		//the simulation thread applies the keys with its next step
 		if(!agentEnabled){
-
-			if (KEYS[SDL_SCANCODE_LEFT]){
-				sim.enableLeftFlipper();
-			}else{
-				sim.disableLeftFlipper();
-			}
-
-			if (KEYS[SDL_SCANCODE_RIGHT]){
-				sim.enableRightFlipper();
-			}else{
-				sim.disableRightFlipper();
-			}
-
+			leftFlipperPressed		= KEYS[SDL_SCANCODE_LEFT];
+			rightFlipperPressed		= KEYS[SDL_SCANCODE_RIGHT];
 		}
 
 		if (KEYS[SDL_SCANCODE_SPACE]){
@@ -142,16 +221,24 @@ void PinballBot::handleKeys(Simulation &sim, SDL_Event &e){
 
 		/*if (KEYS[SDL_SCANCODE_P]){
 			sim.generateRandomPinField();
+			renderer->invalidateStaticTexture();
 		}*/
 
 		if (KEYS[SDL_SCANCODE_S]){
-			rlAgent->savePoliciesToFile();
+			saveRequested = true;
 		}
 
 	}
 }
 
-bool PinballBot::preventStablePositionsOutsideCF(Simulation &sim){
+void PinballBot::setRecording(const std::string &path, Recorder::Format format, unsigned long long interval){
+	recordPath		= path;
+	recordFormat	= format;
+	recordInterval	= interval;
+}
+#endif
+
+bool PinballBot::preventStablePositionsOutsideCF(Simulation &sim, unsigned long long steps, unsigned long long &stepStartedBeingOutsideCF){
 	if(sim.isPlayingBallInsideCaptureFrame()){
 
 		stepStartedBeingOutsideCF = 0;
@@ -175,9 +262,10 @@ bool PinballBot::preventStablePositionsOutsideCF(Simulation &sim){
 	}
 }
 
-void PinballBot::runSimulation(int statesToBackport, float valueAdjustFraction, float epsilon, unsigned long long quitStep, bool dynamicEpsilon, bool randomKickerForce){
+#ifndef PINBALLBOT_HEADLESS
+void PinballBot::runSimulation(int statesToBackport, float traceDecay, float valueAdjustFraction, float epsilon, unsigned long long quitStep, bool dynamicEpsilon, bool randomKickerForce, StateTable::Type tableType){
 
-	Simulation 										sim(randomKickerForce);
+	Simulation 										sim(randomKickerForce, seed);
 	SDL_Event										e;
 
 	std::vector<Action*> availableActions			= ActionsSim::actionsAvailable(sim);
@@ -188,104 +276,560 @@ void PinballBot::runSimulation(int statesToBackport, float valueAdjustFraction,
 			epsilon,
 			availableActions,
 			quitStep,
-			dynamicEpsilon
+			dynamicEpsilon,
+			tableType,
+			Simulation::getCaptureFrameGrid(AGENT_INCLUDE_VELOCITY),
+			traceDecay,
+			seed
 	);
 
 	rlAgent											= &agent;
+	rlAgent->setPolicyEncoding(policyEncoding);
+	rlAgent->setMaxTableMemory(maxTableMemory);
 
-	if(render){
-		renderer									= new Renderer(320, 640, sim.getWorld());
-	}
+	sim.setProfiler(&profiler);
+	profilers										= {&profiler, &renderProfiler};
+
+	//SDL wants the window and its events on the thread that created them, so this one renders
+	renderer										= new Renderer(320, 640, sim.getWorld());
+	nextTime										= SDL_GetTicks();
+
+	//the simulation runs as fast as it can, the window shows its latest frame at FPS
+	std::thread										simulation(&PinballBot::simulate, this, std::ref(sim), quitStep);
 
 	while(!quit){
 
-		if(render){
-			handleKeys(sim, e);
+		handleKeys(e);
+
+		const FrameBuffer::Frame *frame = frames.acquire();
+
+		if(frame != nullptr){
+			PhaseProfiler::Timer timer(&renderProfiler, PhaseProfiler::RENDER);
+
+			renderer->render(*frame);
 		}
 
-		if(!pause){
+		capFramerate();
+	}
+
+	simulation.join();
+
+	delete renderer;
+	renderer										= nullptr;
+}
+
+void PinballBot::simulate(Simulation &sim, unsigned long long quitStep){
+
+	//the steps the last action is still held for
+	int												stepsUntilDecision	= 0;
+
+	sim.setRoundedVelocity(AGENT_INCLUDE_VELOCITY);
+
+	//the key of the state the agent decided in last, anything but the initial one at first
+	uint64_t										lastDecisionKey		= ~sim.getRoundedState().getKey();
+
+	//a human playing needs the table at its real speed
+	std::chrono::steady_clock::duration				stepDuration		= std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<float>(TIME_STEP));
+	std::chrono::steady_clock::time_point			nextStep			= std::chrono::steady_clock::now();
 
-			sim.step(TIME_STEP);
+	while(!quit){
+
+		if(pause){
+			std::this_thread::sleep_for(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<float, std::milli>(TICK_INTERVAL)));
 
-			//Ignore default rewards
-			if(sim.reward != Action::DEFAULT_REWARD){
-				rewardsCollected.push_back(sim.reward);
+			nextStep = std::chrono::steady_clock::now();
+			continue;
+		}
+
+		if(!agentEnabled){
+			std::this_thread::sleep_until(nextStep);
+			nextStep += stepDuration;
+
+			if(leftFlipperPressed){
+				sim.enableLeftFlipper();
+			}else{
+				sim.disableLeftFlipper();
 			}
 
-			if(sim.reward == Action::MIN_REWARD){
-				gameOvers++;
+			if(rightFlipperPressed){
+				sim.enableRightFlipper();
+			}else{
+				sim.disableRightFlipper();
 			}
+		}
+
+		if(saveRequested.exchange(false)){
+			rlAgent->savePoliciesToFile();
+		}
+
+		sim.step(TIME_STEP);
+
+		//Ignore default rewards
+		if(sim.reward != Action::DEFAULT_REWARD){
+			rewardsCollected.push_back(sim.reward);
+		}
+
+		if(sim.reward == Action::MIN_REWARD){
+			gameOvers++;
+		}
+
+		if(stepsUntilDecision > 0){
+			stepsUntilDecision--;
+		}
+
+		//with decideOnChange the agent would only get the same state and trace entry again
+		bool changed = !decideOnChange || !rewardsCollected.empty() || sim.getRoundedState().getKey() != lastDecisionKey;
+
+		//a game over is learned from right away, otherwise the last action is held until the next decision
+		if(sim.reward == Action::MIN_REWARD || (preventStablePositionsOutsideCF(sim, steps, stepStartedBeingOutsideCF) && stepsUntilDecision == 0 && changed)){
+			if(agentEnabled){
+				unsigned long long allocationsBefore = AllocationCounter::getAllocations();
+
+				//the rewards collected while the last action was held are applied together
+				{
+					PhaseProfiler::Timer timer(&profiler, PhaseProfiler::THINK);
 
-			if(sim.reward == Action::MIN_REWARD || preventStablePositionsOutsideCF(sim)){
-				if(agentEnabled){
-					rlAgent->think(sim.getCurrentState(availableActions, AGENT_INCLUDE_VELOCITY), rewardsCollected, steps);
+					rlAgent->think(sim.getRoundedState(), rewardsCollected, steps);
 				}
 
-				statsRewardsCollected += std::accumulate(rewardsCollected.begin(), rewardsCollected.end(), 0.0f);
-				rewardsCollected.clear();
+				statsDecisionAllocations += AllocationCounter::getAllocations() - allocationsBefore;
+				statsDecisions++;
+
+				stepsUntilDecision	= getActionRepeat(sim);
+				lastDecisionKey		= sim.getRoundedState().getKey();
 			}
 
-			if(render){
-				renderer->render(std::to_string((statsRewardsCollected - gameOvers)).c_str());
-				capFramerate();
+			statsRewardsCollected += std::accumulate(rewardsCollected.begin(), rewardsCollected.end(), 0.0f);
+			rewardsCollected.clear();
+		}
+
+		//the renderer draws the latest frame whenever it's ready for one
+		FrameBuffer::Frame &frame = frames.getBack();
+
+		FrameBuffer::capture(sim.getWorld(), frame);
+		frame.score = statsRewardsCollected - gameOvers;
+
+		frames.publish();
+
+		if(steps != 0){
+
+			if(steps % LOG_INTERVAL == 0){
+				printf("step #%lld | amount of states: %ld\n", steps, rlAgent->states.size());
 			}
 
-			if(steps != 0){
+			if(steps >= nextStatsLog){
+				statsStates = rlAgent->states.size();
 
-				if(steps % LOG_INTERVAL == 0){
-					printf("step #%lld | amount of states: %ld\n", steps, rlAgent->states.size());
-				}
+				summarizePhases();
+
+				{
+					PhaseProfiler::Timer timer(&profiler, PhaseProfiler::STATS_LOG);
 
-				if(steps >= nextStatsLog){
 					statsLogger.log(STATS_FILE);
+					timingLogger.log(TIMING_FILE);
+				}
 
-					statsRewardsCollected = 0;
-					gameOvers = 0;
+				statsRewardsCollected = 0;
+				gameOvers = 0;
+				statsDecisions = 0;
+				statsDecisionAllocations = 0;
 
-					/*Increase nextStatsLog with an quadratic function that reaches
-					 * y = MAX_BASE_STATS_MULTIPLE at x = QUIT_STEP
-					 * f(x) = (p-1)/q^2 * x^2 + 1
-					 */
-					if(dynamicStepIncrement && quitStep > 0){
-						deltaStatsLog = (unsigned long long) std::round(baseStatsInterval *
-								((((double)maxBaseStatsMultiple - 1.0f)/((double)quitStep * (double)quitStep)) * (steps * steps) + 1));
+				deltaStatsLog	= getNextStatsLog(nextStatsLog, quitStep) - nextStatsLog;
+				nextStatsLog	+= deltaStatsLog;
 
-					}else{
-						deltaStatsLog = baseStatsInterval;
-					}
+				PhaseProfiler::Timer timer(&profiler, PhaseProfiler::POLICY_SAVE);
 
-					nextStatsLog += deltaStatsLog;
+				rlAgent->savePoliciesToFile();
+			}
 
+			/*if(steps % CLEAR_INTERVAL == 0){
+				unsigned long previouseStateAmount = rlAgent->states.size();
 
-					rlAgent->savePoliciesToFile();
-				}
+				rlAgent->clearStates();
+				sim.respawnBall();
 
-				/*if(steps % CLEAR_INTERVAL == 0){
-					unsigned long previouseStateAmount = rlAgent->states.size();
+				printf("Cleared %lu states, Reduced size from %lu to %lu\n",
+						(previouseStateAmount - rlAgent->states.size()),
+						previouseStateAmount,
+						rlAgent->states.size()
+				);
+			}*/
+		}
 
-					rlAgent->clearStates();
-					sim.respawnBall();
+		steps++;
+
+		if(quitStep != 0 && steps > quitStep){
+			quit = true;
+		}
+	}
+}
+#endif
+
+void PinballBot::runWorkers(int workers, int statesToBackport, float traceDecay, float valueAdjustFraction, float epsilon, unsigned long long quitStep, bool dynamicEpsilon, bool randomKickerForce, StateTable::Type tableType){
+
+	std::vector<Simulation*>						sims(workers);
+	std::vector<std::vector<Action*>>				actions(workers);
+	std::vector<Agent*>								agents(workers);
+	std::vector<WorkerStats>						workerStats(workers);
+	std::vector<std::thread>						threads;
+
+	for(int i=0;i<workers;i++){
+		sims[i]										= new Simulation(randomKickerForce, seed, i);
+		actions[i]									= ActionsSim::actionsAvailable(*sims[i]);
+	}
+
+	//the first agent owns the state table and loads the policies, all others learn into it
+	agents[0]										= new Agent(
+			statesToBackport,
+			valueAdjustFraction,
+			epsilon,
+			actions[0],
+			quitStep,
+			dynamicEpsilon,
+			tableType,
+			Simulation::getCaptureFrameGrid(AGENT_INCLUDE_VELOCITY),
+			traceDecay,
+			seed
+	);
+
+	for(int i=1;i<workers;i++){
+		agents[i]									= new Agent(*agents[0], actions[i], i);
+	}
+
+	rlAgent											= agents[0];
+	rlAgent->setPolicyEncoding(policyEncoding);
+	rlAgent->setMaxTableMemory(maxTableMemory);
+
+	profilers										= {&profiler};
+
+	for(int i=0;i<workers;i++){
+		sims[i]->setProfiler(&workerStats[i].profiler);
+		profilers.push_back(&workerStats[i].profiler);
+	}
 
-					printf("Cleared %lu states, Reduced size from %lu to %lu\n",
-							(previouseStateAmount - rlAgent->states.size()),
-							previouseStateAmount,
-							rlAgent->states.size()
-					);
-				}*/
+#ifndef PINBALLBOT_HEADLESS
+	//the first worker renders into a surface, neither a display nor a video driver is needed
+	if(!recordPath.empty()){
+		renderer									= new Renderer(320, 640, sims[0]->getWorld(), true);
+		recorder									= new Recorder(recordPath, recordFormat, renderer->getWidth(), renderer->getHeight());
+
+		if(recorder->isOpen()){
+			printf("Recording every %llu. step of the first worker to %s (%s, %dx%d)\n", recordInterval, recordPath.c_str(),
+					Recorder::getFormatName(recordFormat).c_str(), renderer->getWidth(), renderer->getHeight());
+		}
+	}
+#endif
+
+	printf("Starting %d workers\n", workers);
+
+	std::chrono::steady_clock::time_point			started			= std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point			lastLog			= started;
+	unsigned long long								nextLog			= LOG_INTERVAL;
+	unsigned long long								stepsLastLog	= 0;
+	unsigned long long								stepsLastStats	= 0;
+
+	//the totals at the last stats log, the stats are the difference to them
+	double											rewardsLastStats	= 0;
+	unsigned long long								gameOversLastStats	= 0;
+	unsigned long long								decisionsLastStats	= 0;
+	unsigned long long								allocationsLastStats	= 0;
+
+	for(int i=0;i<workers;i++){
+		threads.push_back(std::thread(&PinballBot::runWorker, this, std::ref(*sims[i]), std::ref(*agents[i]), std::ref(workerStats[i]), i, workers, quitStep));
+	}
+
+	bool running = true;
+
+	while(running){
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(WORKER_POLL_INTERVAL));
+
+		running	= false;
+		steps	= 0;
+
+		for(int i=0;i<workers;i++){
+			steps			+= workerStats[i].steps.load(std::memory_order_relaxed);
+			running			= running || !workerStats[i].done.load(std::memory_order_acquire);
+		}
+
+		if(steps >= nextLog){
+			std::chrono::steady_clock::time_point	now		= std::chrono::steady_clock::now();
+			double									seconds	= std::chrono::duration<double>(now - lastLog).count();
+			double									rate	= (steps - stepsLastLog) / seconds;
+
+			printf("step #%lld | amount of states: %ld | %.0f steps/sec, %.0f steps/sec per worker (%d workers) | %.1f simulated s per real s\n",
+					steps, rlAgent->states.size(), rate, rate / workers, workers, rate * TIME_STEP);
+
+			lastLog			= now;
+			stepsLastLog	= steps;
+			nextLog			= (steps / LOG_INTERVAL + 1) * LOG_INTERVAL;
+		}
+
+		//log every stats log all workers passed, with the totals they recorded at it
+		while(true){
+			bool complete = true;
+
+			for(int i=0;i<workers && complete;i++){
+				std::lock_guard<std::mutex> guard(workerStats[i].recordLock);
+				complete = !workerStats[i].records.empty();
+			}
+
+			if(!complete){
+				break;
 			}
 
-			steps++;
+			StatsRecord total = {0, 0, 0, 0, 0, 0};
 
-			if(quitStep != 0 && steps > quitStep){
-				quit = true;
+			for(int i=0;i<workers;i++){
+				std::lock_guard<std::mutex> guard(workerStats[i].recordLock);
+				const StatsRecord &record = workerStats[i].records.front();
+
+				total.steps					+= record.steps;
+				total.gameOvers				+= record.gameOvers;
+				total.decisions				+= record.decisions;
+				total.decisionAllocations	+= record.decisionAllocations;
+				total.rewardsCollected		+= record.rewardsCollected;
+				total.states				= std::max(total.states, record.states);
+
+				workerStats[i].records.pop_front();
 			}
 
-		}else{
-			nextTime = SDL_GetTicks() + TICK_INTERVAL;
+			steps						= total.steps;
+			statsRewardsCollected		= total.rewardsCollected - rewardsLastStats;
+			gameOvers					= total.gameOvers - gameOversLastStats;
+			statsDecisions				= total.decisions - decisionsLastStats;
+			statsDecisionAllocations	= total.decisionAllocations - allocationsLastStats;
+			statsStates					= total.states;
+			deltaStatsLog				= total.steps - stepsLastStats;
+
+			summarizePhases();
+
+			{
+				PhaseProfiler::Timer timer(&profiler, PhaseProfiler::STATS_LOG);
+
+				statsLogger.log(STATS_FILE);
+				timingLogger.log(TIMING_FILE);
+			}
+
+			rewardsLastStats		= total.rewardsCollected;
+			gameOversLastStats		= total.gameOvers;
+			decisionsLastStats		= total.decisions;
+			allocationsLastStats	= total.decisionAllocations;
+			stepsLastStats			= total.steps;
+
+			//only takes a snapshot, the workers keep updating the table while it's written
+			PhaseProfiler::Timer timer(&profiler, PhaseProfiler::POLICY_SAVE);
+
+			rlAgent->savePoliciesToFile();
+		}
+	}
+
+	for(int i=0;i<workers;i++){
+		threads[i].join();
+	}
+
+	steps = 0;
+
+	for(int i=0;i<workers;i++){
+		steps += workerStats[i].steps.load(std::memory_order_relaxed);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+	printf("%d workers took %lld steps in %.1f s: %.0f steps/sec, %.0f steps/sec per worker, %.1f simulated s per real s\n",
+			workers, steps, seconds, steps / seconds, steps / seconds / workers, steps / seconds * TIME_STEP);
+
+	rlAgent											= nullptr;
+	profilers										= {};
+
+#ifndef PINBALLBOT_HEADLESS
+	//writes the frames still waiting for the encoder
+	delete recorder;
+	recorder										= nullptr;
+
+	delete renderer;
+	renderer										= nullptr;
+#endif
+
+	//the other agents use the state table of the first one
+	for(int i=workers-1;i>=0;i--){
+		delete agents[i];
+		delete sims[i];
+
+		for(int j=0;j<actions[i].size();j++){
+			delete actions[i][j];
+		}
+	}
+}
+
+void PinballBot::runWorker(Simulation &sim, Agent &agent, WorkerStats &stats, int worker, int workers, unsigned long long quitStep){
+
+	std::vector<float>								rewardsCollected;
+	unsigned long long								steps						= 0;
+	unsigned long long								stepStartedBeingOutsideCF	= 0;
+	int												stepsUntilDecision			= 0;
+
+	sim.setRoundedVelocity(AGENT_INCLUDE_VELOCITY);
+
+	uint64_t										lastDecisionKey				= ~sim.getRoundedState().getKey();
+
+	//quitStep counts the steps of all workers together, every worker takes its share
+	unsigned long long								workerQuitStep				= getWorkerShare(quitStep, worker, workers);
+
+	//the next stats log of all workers and the step this worker records its totals for it at
+	unsigned long long								statsLog					= baseStatsInterval;
+	unsigned long long								nextRecord					= getWorkerShare(statsLog, worker, workers);
+
+	while(quitStep == 0 || steps <= workerQuitStep){
+
+		sim.step(TIME_STEP);
+
+		//Ignore default rewards
+		if(sim.reward != Action::DEFAULT_REWARD){
+			rewardsCollected.push_back(sim.reward);
+		}
+
+		if(sim.reward == Action::MIN_REWARD){
+			stats.gameOvers.store(stats.gameOvers.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		if(stepsUntilDecision > 0){
+			stepsUntilDecision--;
+		}
+
+		//see runSimulation()
+		bool changed = !decideOnChange || !rewardsCollected.empty() || sim.getRoundedState().getKey() != lastDecisionKey;
+
+		if(sim.reward == Action::MIN_REWARD || (preventStablePositionsOutsideCF(sim, steps, stepStartedBeingOutsideCF) && stepsUntilDecision == 0 && changed)){
+			if(agentEnabled){
+				unsigned long long allocationsBefore = AllocationCounter::getAllocations();
+
+				//the epsilon follows the steps of all workers together, they all run at about the same speed
+				{
+					PhaseProfiler::Timer timer(&stats.profiler, PhaseProfiler::THINK);
+
+					agent.think(sim.getRoundedState(), rewardsCollected, steps * workers);
+				}
+
+				stats.decisionAllocations.store(stats.decisionAllocations.load(std::memory_order_relaxed)
+						+ AllocationCounter::getAllocations() - allocationsBefore, std::memory_order_relaxed);
+				stats.decisions.store(stats.decisions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+				stepsUntilDecision	= getActionRepeat(sim);
+				lastDecisionKey		= sim.getRoundedState().getKey();
+			}
+
+			stats.rewardsCollected.store(stats.rewardsCollected.load(std::memory_order_relaxed)
+					+ std::accumulate(rewardsCollected.begin(), rewardsCollected.end(), 0.0f), std::memory_order_relaxed);
+			rewardsCollected.clear();
+		}
+
+		steps++;
+		stats.steps.store(steps, std::memory_order_relaxed);
+
+#ifndef PINBALLBOT_HEADLESS
+		if(recorder != nullptr && worker == 0 && steps % recordInterval == 0){
+			//a frame is dropped without rendering it if the encoder fell behind
+			uint8_t *pixels = recorder->beginFrame();
+
+			if(pixels != nullptr){
+				PhaseProfiler::Timer timer(&stats.profiler, PhaseProfiler::RENDER);
+
+				renderer->render(std::to_string(stats.rewardsCollected.load(std::memory_order_relaxed) - stats.gameOvers.load(std::memory_order_relaxed)).c_str());
+				recorder->endFrame(renderer->readPixels(pixels));
+			}
 		}
+#endif
+
+		//the share of a worker can stay the same between two stats logs if there are more workers than steps in between
+		while(steps >= nextRecord){
+			StatsRecord record = {
+					steps,
+					stats.gameOvers.load(std::memory_order_relaxed),
+					stats.decisions.load(std::memory_order_relaxed),
+					stats.decisionAllocations.load(std::memory_order_relaxed),
+					stats.rewardsCollected.load(std::memory_order_relaxed),
+					agent.states.size()
+			};
+
+			{
+				std::lock_guard<std::mutex> guard(stats.recordLock);
+				stats.records.push_back(record);
+			}
 
+			statsLog	= getNextStatsLog(statsLog, quitStep);
+			nextRecord	= getWorkerShare(statsLog, worker, workers);
+		}
 	}
 
+	stats.done.store(true, std::memory_order_release);
+}
+
+int PinballBot::getActionRepeat(Simulation &sim) const{
+	if(!adaptiveActionRepeat){
+		return actionRepeat;
+	}
+
+	//a slow ball barely moves during a long hold, a fast one needs a decision every step
+	return std::max(1, (int) (actionRepeat / (1.0f + sim.getBallSpeed() / ACTION_REPEAT_HALF_SPEED)));
+}
+
+unsigned long long PinballBot::getNextStatsLog(unsigned long long statsLog, unsigned long long quitStep) const{
+	/*Increase nextStatsLog with an quadratic function that reaches
+	 * y = MAX_BASE_STATS_MULTIPLE at x = QUIT_STEP
+	 * f(x) = (p-1)/q^2 * x^2 + 1
+	 */
+	if(dynamicStepIncrement && quitStep > 0){
+		return statsLog + (unsigned long long) std::round(baseStatsInterval *
+				((((double)maxBaseStatsMultiple - 1.0f)/((double)quitStep * (double)quitStep)) * (statsLog * statsLog) + 1));
+	}else{
+		return statsLog + baseStatsInterval;
+	}
+}
+
+unsigned long long PinballBot::getWorkerShare(unsigned long long steps, int worker, int workers){
+	return steps / workers + ((unsigned long long) worker < steps % workers ? 1 : 0);
+}
+
+void PinballBot::convertPolicies(const std::string &importFile, const std::string &exportFile, StateTable::Type tableType, PolicyFile::Encoding encoding){
+
+	//the actions are bound to a simulation, it's never stepped
+	Simulation										sim(false);
+	std::vector<Action*> availableActions			= ActionsSim::actionsAvailable(sim);
+
+	//loads POLICIES_FILE
+	Agent											agent(
+			Agent::DEFAULT_STATES_TO_BACKPORT,
+			Agent::DEFAULT_VALUE_ADJUST_FRACTION,
+			Agent::DEFAULT_EPSILON,
+			availableActions,
+			Agent::DEFAULT_STEPS_UNTIL_MIN_EPSILON,
+			Agent::DEFAULT_DYNAMIC_EPSILON,
+			tableType,
+			Simulation::getCaptureFrameGrid(AGENT_INCLUDE_VELOCITY)
+	);
+
+	agent.setPolicyEncoding(encoding);
+
+	if(!importFile.empty()){
+		agent.importPoliciesFromCSV(importFile);
+		agent.savePoliciesToFile();
+		agent.flushPolicies();
+
+		printf("Imported %s into %s\n", importFile.c_str(), POLICIES_FILE.c_str());
+	}
+
+	if(!exportFile.empty()){
+		agent.exportPoliciesToCSV(exportFile);
+
+		printf("Exported %lu states of %s to %s\n", agent.states.size(), POLICIES_FILE.c_str(), exportFile.c_str());
+	}
+
+	for(int i=0;i<availableActions.size();i++){
+		delete availableActions[i];
+	}
 }
 
 void PinballBot::shutdownHook(){
@@ -293,6 +837,7 @@ void PinballBot::shutdownHook(){
 
 	//archive previous log file
 	statsLogger.archiveLog(STATS_FILE);
+	timingLogger.archiveLog(TIMING_FILE);
 }
 
 double PinballBot::normalizeReward(double reward){
@@ -308,12 +853,14 @@ std::string PinballBot::logTime(){
 }
 
 std::string PinballBot::logAmountOfStates(){
-	return std::to_string(rlAgent->states.size());
+	return std::to_string(statsStates);
 }
 
 std::string PinballBot::logAverageTimePerLoop(){
-	std::string r	= std::to_string(( ((double)(std::time(nullptr) - timeLastLog)) / ( (double)deltaStatsLog) ));
-	timeLastLog		= std::time(nullptr);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	std::string r	= std::to_string(std::chrono::duration<double, std::micro>(now - timeLastLog).count() / (double) deltaStatsLog);
+	timeLastLog		= now;
 
 	return r;
 }
@@ -334,6 +881,58 @@ std::string PinballBot::logScore(){
 	return std::to_string((normalizeReward(statsRewardsCollected) - normalizeReward((double) gameOvers)));
 }
 
+std::string PinballBot::logAllocationsPerDecision(){
+	return std::to_string(statsDecisions == 0 ? 0.0 : (double) statsDecisionAllocations / (double) statsDecisions);
+}
+
+void PinballBot::summarizePhases(){
+	for(int p=0;p<PhaseProfiler::PHASE_COUNT;p++){
+		phaseSummaries[p] = PhaseProfiler::summarize(profilers, (PhaseProfiler::Phase) p);
+	}
+}
+
+std::string PinballBot::logStepsPerDecision(){
+	return std::to_string(statsDecisions == 0 ? 0.0 : (double) deltaStatsLog / (double) statsDecisions);
+}
+
+std::string PinballBot::logSnapshotPause(){
+	return std::to_string(rlAgent->getSnapshotPause());
+}
+
+std::string PinballBot::logPolicyWriteDuration(){
+	return std::to_string(rlAgent->getWriteDuration());
+}
+
+std::string PinballBot::logPolicyCheckpointRows(){
+	return std::to_string(rlAgent->getCheckpointRows());
+}
+
+std::string PinballBot::logStatesEvicted(){
+	return std::to_string(rlAgent->getEvictedStates());
+}
+
+std::string PinballBot::logEvictionSlice(){
+	return std::to_string(rlAgent->getEvictionSlice());
+}
+
+#ifndef PINBALLBOT_HEADLESS
+std::string PinballBot::logRecordedFrames(){
+	return std::to_string(recorder != nullptr ? recorder->getEncodedFrames() : 0);
+}
+
+std::string PinballBot::logDroppedFrames(){
+	return std::to_string(recorder != nullptr ? recorder->getDroppedFrames() : 0);
+}
+
+std::string PinballBot::logRecordDuration(){
+	return std::to_string(recorder != nullptr ? recorder->getCaptureDuration() : -1);
+}
+
+std::string PinballBot::logEncodeDuration(){
+	return std::to_string(recorder != nullptr ? recorder->getEncodeDuration() : -1);
+}
+#endif
+
 int main(int argc, char** argv) {
 	//PinballBot
 
@@ -348,10 +947,27 @@ int main(int argc, char** argv) {
 
 	//Agent
 	int						statesToBackport;
+	float					traceDecay;
 	float					valueAdjustFraction;
 	float					epsilon;
 	bool					dynamicEpsilon;
 
+	std::string				table;
+	int						workers;
+	uint64_t				seed;
+	int						actionRepeat;
+	bool					adaptiveActionRepeat;
+	bool					decideOnChange;
+
+	std::string				policyEncoding;
+	size_t					maxTableMemory;
+	std::string				importFile;
+	std::string				exportFile;
+
+	std::string				recordPath;
+	std::string				recordFormat;
+	unsigned long long		recordInterval;
+
 	//Sim
 	bool					randomKickerForce;
 
@@ -381,6 +997,9 @@ int main(int argc, char** argv) {
 		// Option 'states-to-backport' and 's' are equivalent.
 		("states-to-backport,s", boost::program_options::value<int>(& statesToBackport)->default_value(Agent::DEFAULT_STATES_TO_BACKPORT),
 			"The amount of states to backport")
+		// Option 'trace-decay' and 'l' are equivalent.
+		("trace-decay,l", boost::program_options::value<float>(& traceDecay)->default_value(TraceBuffer::DEFAULT_DECAY),
+			"The factor a backported reward shrinks with per state, 1.0 => every state gets the full reward")
 		// Option 'value-adjust-fraction' and 'v' are equivalent.
 		("value-adjust-fraction,v", boost::program_options::value<float>(& valueAdjustFraction)->default_value(Agent::DEFAULT_VALUE_ADJUST_FRACTION),
 			"The fraction of the difference that should be added to the previous value")
@@ -393,6 +1012,41 @@ int main(int argc, char** argv) {
 		// Option 'dynamic-epsilon' and 'y' are equivalent.
 		("dynamic-epsilon,y", boost::program_options::value<bool>(& dynamicEpsilon)->default_value(Agent::DEFAULT_DYNAMIC_EPSILON),
 			"Whether to use a dynamic epsilon")
+		// Option 'table' and 't' are equivalent.
+		("table,t", boost::program_options::value<std::string>(& table)->default_value(PinballBot::DEFAULT_TABLE),
+			"The state table: 'sparse' (hash index) or 'dense' (preallocated index over the capture frame)")
+		// Option 'workers' and 'w' are equivalent.
+		("workers,w", boost::program_options::value<int>(& workers)->default_value(PinballBot::DEFAULT_WORKERS),
+			"The amount of simulations trained in parallel, each on its own thread sharing one state table. Requires --render 0")
+		// Option 'action-repeat' and 'k' are equivalent.
+		("action-repeat,k", boost::program_options::value<int>(& actionRepeat)->default_value(PinballBot::DEFAULT_ACTION_REPEAT),
+			"The amount of steps an action is held for before the agent decides again, the rewards in between are learned from together")
+		// Option 'adaptive-action-repeat' and 'g' are equivalent.
+		("adaptive-action-repeat,g", boost::program_options::value<bool>(& adaptiveActionRepeat)->default_value(PinballBot::DEFAULT_ADAPTIVE_ACTION_REPEAT),
+			"Whether to shorten the hold for a fast ball, --action-repeat is the hold of a ball at rest")
+		// Option 'decide-on-change' and 'c' are equivalent.
+		("decide-on-change,c", boost::program_options::value<bool>(& decideOnChange)->default_value(PinballBot::DEFAULT_DECIDE_ON_CHANGE),
+			"Whether the agent only decides once the rounded state changed or a reward arrived, the action is held until then")
+		("seed", boost::program_options::value<uint64_t>(& seed),
+			"The seed all random number generators are derived from, a run with one worker repeats exactly. Defaults to the clock")
+
+		// Option 'policy-encoding' and 'p' are equivalent.
+		("policy-encoding,p", boost::program_options::value<std::string>(& policyEncoding)->default_value(PinballBot::DEFAULT_POLICY_ENCODING),
+			"How the values are stored in the policy file: 'float32' (lossless) or 'uint16' (quantized, half the size)")
+		// Option 'max-table-memory' and 'x' are equivalent.
+		("max-table-memory,x", boost::program_options::value<size_t>(& maxTableMemory)->default_value(PinballBot::DEFAULT_MAX_TABLE_MEMORY),
+			"The memory the state table may use in MB, cold states are evicted beyond that and dropped from the policy file by the next compaction. 0 => unlimited")
+		("import-csv", boost::program_options::value<std::string>(& importFile),
+			"Imports a csv policy file into the binary policy file and quits")
+		("export-csv", boost::program_options::value<std::string>(& exportFile),
+			"Exports the binary policy file to a csv file and quits")
+
+		("record", boost::program_options::value<std::string>(& recordPath),
+			"Records the first worker offscreen to this file or pipe (raw) or directory (png), works without a display. Requires --render 0")
+		("record-format", boost::program_options::value<std::string>(& recordFormat)->default_value(PinballBot::DEFAULT_RECORD_FORMAT),
+			"How the frames are recorded: 'raw' (one stream of packed rgb24 frames) or 'png' (a numbered sequence)")
+		("record-interval", boost::program_options::value<unsigned long long>(& recordInterval)->default_value(PinballBot::DEFAULT_RECORD_INTERVAL),
+			"The amount of steps between two recorded frames")
 
 		// Option 'random-kicker-force' and 'f' are equivalent.
 		("random-kicker-force,f", boost::program_options::value<bool>(& randomKickerForce)->default_value(ContactListener::RANDOM_KICKER_FORCE),
@@ -409,11 +1063,103 @@ int main(int argc, char** argv) {
 		return 0;
 	}
 
-	PinballBot bot(agentEnabled, dynamicStepIncrement, render, baseStatsInterval, maxBaseStatsMultiple);
+	StateTable::Type tableType;
+
+	if(table == StateTable::getTypeName(StateTable::DENSE)){
+		tableType = StateTable::DENSE;
+	}else if(table == StateTable::getTypeName(StateTable::SPARSE)){
+		tableType = StateTable::SPARSE;
+	}else{
+		std::cout << "Unknown table '" << table << "', use 'dense' or 'sparse'\n";
+		return 1;
+	}
+
+	PolicyFile::Encoding encoding;
+
+	if(policyEncoding == PolicyFile::getEncodingName(PolicyFile::FLOAT32)){
+		encoding = PolicyFile::FLOAT32;
+	}else if(policyEncoding == PolicyFile::getEncodingName(PolicyFile::UINT16)){
+		encoding = PolicyFile::UINT16;
+	}else{
+		std::cout << "Unknown policy encoding '" << policyEncoding << "', use 'float32' or 'uint16'\n";
+		return 1;
+	}
+
+	if(!importFile.empty() || !exportFile.empty()){
+		PinballBot::convertPolicies(importFile, exportFile, tableType, encoding);
+		return 0;
+	}
+
+#ifdef PINBALLBOT_HEADLESS
+	if(render){
+		std::cout << "This build is headless and can't render, use --render 0\n";
+		return 1;
+	}
+
+	if(!recordPath.empty()){
+		std::cout << "This build is headless and can't record, the renderer is compiled out\n";
+		return 1;
+	}
+#else
+	Recorder::Format format;
+
+	if(recordFormat == Recorder::getFormatName(Recorder::RAW)){
+		format = Recorder::RAW;
+	}else if(recordFormat == Recorder::getFormatName(Recorder::PNG)){
+		format = Recorder::PNG;
+	}else{
+		std::cout << "Unknown record format '" << recordFormat << "', use 'raw' or 'png'\n";
+		return 1;
+	}
+#endif
+
+	if(!recordPath.empty() && render){
+		std::cout << "Recording renders offscreen, use --render 0 with --record\n";
+		return 1;
+	}
+
+	if(recordInterval < 1){
+		std::cout << "There has to be at least one step between two recorded frames\n";
+		return 1;
+	}
+
+	if(actionRepeat < 1){
+		std::cout << "An action has to be held for at least one step\n";
+		return 1;
+	}
+
+	if(workers < 1){
+		std::cout << "There has to be at least one worker\n";
+		return 1;
+	}else if(workers > 1 && render){
+		std::cout << "Only one simulation can be rendered, use --render 0 with multiple workers\n";
+		return 1;
+	}
+
+	if(!vm.count("seed")){
+		seed = Seeds::fromClock();
+	}
+
+	printf("Using seed %llu, pass --seed %llu to repeat this run\n", (unsigned long long) seed, (unsigned long long) seed);
+
+	PinballBot bot(agentEnabled, dynamicStepIncrement, render, baseStatsInterval, maxBaseStatsMultiple, encoding, maxTableMemory * 1024 * 1024, seed,
+			actionRepeat, adaptiveActionRepeat, decideOnChange);
 
 	//atexit(shutdownHook);
 
-	bot.runSimulation(statesToBackport, valueAdjustFraction, epsilon, quitStep, dynamicEpsilon, randomKickerForce);
+#ifndef PINBALLBOT_HEADLESS
+	if(!recordPath.empty()){
+		bot.setRecording(recordPath, format, recordInterval);
+	}
+
+	if(render){
+		bot.runSimulation(statesToBackport, traceDecay, valueAdjustFraction, epsilon, quitStep, dynamicEpsilon, randomKickerForce, tableType);
+		return 0;
+	}
+#endif
+
+	//steps as fast as possible, even a single worker doesn't wait for a frame
+	bot.runWorkers(workers, statesToBackport, traceDecay, valueAdjustFraction, epsilon, quitStep, dynamicEpsilon, randomKickerForce, tableType);
 
 	return 0;
 }
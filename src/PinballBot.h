@@ -1,6 +1,10 @@
 /*
  * PinballBot.h
  *
+ * Defining PINBALLBOT_HEADLESS compiles out the renderer and everything SDL, for machines without a display.
+ * The pinballbot-headless target of CMakeLists.txt builds it like that, with neither SDL headers nor SDL libraries:
+ *   cmake -S . -B build && cmake --build build --target pinballbot-headless
+ * Such a build always trains without rendering, as fast as the cpu allows
  */
 
 #ifndef PINBALLBOT_H_
@@ -14,19 +18,35 @@
 #include <numeric>
 #include <ctime>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <cstdint>
+#include <chrono>
 
+#ifndef PINBALLBOT_HEADLESS
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_main.h>
+#endif
 
 #include "action/ActionsSim.cpp"
 
 #include "sim/Simulation.h"
+
+#ifndef PINBALLBOT_HEADLESS
 #include "sim/Renderer.h"
+#include "sim/FrameBuffer.h"
+#include "sim/Recorder.h"
+#endif
 
 #include "agent/Agent.h"
 #include "agent/State.h"
+#include "agent/StateTable.h"
+#include "agent/PolicyFile.h"
 
 #include "stats/StatsLogger.h"
+#include "stats/AllocationCounter.h"
+#include "stats/PhaseProfiler.h"
 
 class PinballBot{
 
@@ -53,27 +73,104 @@ class PinballBot{
 
 		static const unsigned long long		DEFAULT_QUIT_STEP;
 
+		static const std::string			DEFAULT_TABLE;
+
+		static const int					DEFAULT_WORKERS;
+		static const unsigned int			WORKER_POLL_INTERVAL;
+
+		static const int					DEFAULT_ACTION_REPEAT;
+		static const bool					DEFAULT_ADAPTIVE_ACTION_REPEAT;
+		static const float					ACTION_REPEAT_HALF_SPEED;
+
+		static const bool					DEFAULT_DECIDE_ON_CHANGE;
+
 		static const std::string			STATS_FILE;
+		static const std::string			TIMING_FILE;
 		static const std::string			POLICIES_FILE;
+		static const std::string			POLICIES_DELTA_FILE;
+		static const std::string			POLICIES_CSV_FILE;
+
+		static const std::string			DEFAULT_POLICY_ENCODING;
+
+		static const size_t					DEFAULT_MAX_TABLE_MEMORY;
+
+		static const std::string			DEFAULT_RECORD_FORMAT;
+		static const unsigned long long		DEFAULT_RECORD_INTERVAL;
 
 	private:
 
+		/**
+		 * The totals of one worker at one of the stats logs
+		 */
+		struct StatsRecord{
+			unsigned long long				steps;
+			unsigned long long				gameOvers;
+			unsigned long long				decisions;
+			unsigned long long				decisionAllocations;
+			double							rewardsCollected;
+			size_t							states;
+		};
+
+		/**
+		 * The counters of one worker, only written by the worker itself and read by the thread logging the stats
+		 */
+		struct alignas(64) WorkerStats{
+			std::atomic<unsigned long long>	steps;
+			std::atomic<unsigned long long>	gameOvers;
+			std::atomic<unsigned long long>	decisions;
+			std::atomic<unsigned long long>	decisionAllocations;
+			std::atomic<double>				rewardsCollected;
+			std::atomic<bool>				done;
+
+			//the phases of the worker's steps
+			PhaseProfiler					profiler;
+
+			//the totals at the stats logs the worker passed, until the logging thread logs them
+			std::mutex						recordLock;
+			std::deque<StatsRecord>			records;
+		};
+
+#ifndef PINBALLBOT_HEADLESS
 		const Uint8*						KEYS;
 
-		bool								pause;
-		bool								quit;
+		//set by the rendering thread, read by the simulation thread
+		std::atomic<bool>					pause;
+		std::atomic<bool>					quit;
+
+		std::atomic<bool>					leftFlipperPressed;
+		std::atomic<bool>					rightFlipperPressed;
+		std::atomic<bool>					saveRequested;
 
 		Uint32								nextTime;
 
-		Agent*								rlAgent;
 		Renderer*							renderer;
 
+		//the latest frames of the simulation thread for the rendering thread
+		FrameBuffer							frames;
+
+		//the phases of the rendering thread
+		PhaseProfiler						renderProfiler;
+
+		//records the first worker through an offscreen renderer, nullptr unless a recording path is set
+		Recorder*							recorder;
+		std::string							recordPath;
+		Recorder::Format					recordFormat;
+		unsigned long long					recordInterval;
+#endif
+
+		Agent*								rlAgent;
+
+		//STATS_FILE only gets the learning progress, TIMING_FILE how long things took, see the constructor
 		StatsLogger							statsLogger;
+		StatsLogger							timingLogger;
 
 		unsigned long long 					steps;
 		double 								statsRewardsCollected;
-		unsigned long long 					timeLastLog;
+		std::chrono::steady_clock::time_point	timeLastLog;
 		unsigned long long 					gameOvers;
+		unsigned long long 					statsDecisions;
+		unsigned long long 					statsDecisionAllocations;
+		size_t								statsStates;
 
 		unsigned long long 					stepStartedBeingOutsideCF;
 		unsigned long long					nextStatsLog;
@@ -81,6 +178,13 @@ class PinballBot{
 
 		std::vector<float> 					rewardsCollected;
 
+		//the phases of the thread running the simulation or logging the stats of the workers
+		PhaseProfiler						profiler;
+
+		//all profilers of the current run and what they recorded until the last stats log
+		std::vector<PhaseProfiler*>			profilers;
+		PhaseProfiler::Summary				phaseSummaries[PhaseProfiler::PHASE_COUNT];
+
 
 		const bool							agentEnabled;
 		const bool							render;
@@ -89,13 +193,31 @@ class PinballBot{
 		const unsigned long long			baseStatsInterval;
 		const unsigned int					maxBaseStatsMultiple;
 
+		const PolicyFile::Encoding			policyEncoding;
+
+		//in bytes, 0 = unlimited
+		const size_t						maxTableMemory;
+
+		//the seed of the run, all random number generators are derived from it
+		const uint64_t						seed;
+
+		//the amount of steps an action is held for, the maximum if adaptiveActionRepeat is set
+		const int							actionRepeat;
+		const bool							adaptiveActionRepeat;
+
+		//whether the agent only decides once the rounded state changed or there is a reward to learn from
+		const bool							decideOnChange;
+
 	public:
 
 		PinballBot(
 				bool agentEnabled, bool dynamicStepIncrement, bool render,
-				unsigned long long baseStatsInterval, unsigned int maxBaseStatsMultiple
+				unsigned long long baseStatsInterval, unsigned int maxBaseStatsMultiple,
+				PolicyFile::Encoding policyEncoding, size_t maxTableMemory, uint64_t seed,
+				int actionRepeat, bool adaptiveActionRepeat, bool decideOnChange
 		);
 
+#ifndef PINBALLBOT_HEADLESS
 		/**
 		 * Returns the time left for the next frame
 		 * @return		Uint32
@@ -109,27 +231,107 @@ class PinballBot{
 		void capFramerate();
 
 		/**
-		 * Handles the keys being pressed
-		 * @param	sim	Simulation		The running simulation
+		 * Handles the keys being pressed, the simulation thread picks them up with its next step
 		 * @param	e	SDL_Event		An sdl event
 		 * @return		void
 		 */
 
-		void handleKeys(Simulation &sim, SDL_Event &e);
+		void handleKeys(SDL_Event &e);
+
+		/**
+		 * Records every interval-th step of the first worker of runWorkers(), the frames are rendered offscreen
+		 * @param	path		std::string				The file or pipe for Recorder::RAW, the directory for Recorder::PNG
+		 * @param	format		Recorder::Format		How the frames are written
+		 * @param	interval	unsigned long long		The amount of steps between two frames
+		 * @return				void
+		 */
+		void setRecording(const std::string &path, Recorder::Format format, unsigned long long interval);
+#endif
 
 		/**
 		 * Checks whether the ball is in- or outside the capture frame and if so for how long.
 		 * If it stayed there longer than OUTSIDE_CF_UNTIL_RESPAWN, respawn the ball
-		 * @return		bool	Whether the ball is inside the CF
+		 * @param	sim							Simulation				The running simulation
+		 * @param	steps						unsigned long long		The steps taken in this simulation
+		 * @param	stepStartedBeingOutsideCF	unsigned long long&		The step the ball left the CF, 0 if it's inside
+		 * @return								bool					Whether the ball is inside the CF
 		 */
 
-		bool preventStablePositionsOutsideCF(Simulation &sim);
+		bool preventStablePositionsOutsideCF(Simulation &sim, unsigned long long steps, unsigned long long &stepStartedBeingOutsideCF);
 
+#ifndef PINBALLBOT_HEADLESS
 		/**
-		 * Runs the simulation
+		 * Runs the simulation on its own thread and renders its latest frame at FPS on this one.
+		 * The simulation isn't throttled unless a human is playing (agent disabled)
 		 * @return		void
 		 */
-		void runSimulation(int statesToBackport, float valueAdjustFraction, float epsilon, unsigned long long quitStep, bool dynamicEpsilon, bool randomKickerForce);
+		void runSimulation(int statesToBackport, float traceDecay, float valueAdjustFraction, float epsilon, unsigned long long quitStep, bool dynamicEpsilon, bool randomKickerForce, StateTable::Type tableType);
+
+		/**
+		 * The loop of the simulation thread started by runSimulation(), publishes a frame after every step
+		 * @param	sim			Simulation				The simulation to step
+		 * @param	quitStep	unsigned long long		The step to quit at, 0 = never
+		 * @return				void
+		 */
+		void simulate(Simulation &sim, unsigned long long quitStep);
+#endif
+
+		/**
+		 * Runs multiple simulations without rendering, each on its own thread. All agents learn into one state table,
+		 * the stats are logged for all of them together
+		 * @param	workers		int		The amount of simulations
+		 * @return				void
+		 */
+		void runWorkers(int workers, int statesToBackport, float traceDecay, float valueAdjustFraction, float epsilon, unsigned long long quitStep, bool dynamicEpsilon, bool randomKickerForce, StateTable::Type tableType);
+
+		/**
+		 * The loop of one worker thread. The steps of all workers are split evenly, the worker records its totals
+		 * once it took its share of the steps until the next stats log, so the stats don't depend on the timing of the threads
+		 * @param	sim			Simulation				The simulation of the worker
+		 * @param	agent		Agent					The agent of the worker
+		 * @param	stats		WorkerStats				The counters of the worker
+		 * @param	worker		int						The number of the worker
+		 * @param	workers		int						The amount of workers, the agent sees the steps of all of them
+		 * @param	quitStep	unsigned long long		The amount of steps of all workers after which they quit, 0 = never
+		 * @return				void
+		 */
+		void runWorker(Simulation &sim, Agent &agent, WorkerStats &stats, int worker, int workers, unsigned long long quitStep);
+
+		/**
+		 * Returns for how many steps the action just taken is held. With adaptiveActionRepeat the hold shrinks
+		 * with the speed of the ball, it's halved at ACTION_REPEAT_HALF_SPEED
+		 * @param	sim			Simulation				The running simulation
+		 * @return				int						At least 1 and at most actionRepeat
+		 */
+		int getActionRepeat(Simulation &sim) const;
+
+		/**
+		 * Returns the step of the stats log following one, see dynamicStepIncrement
+		 * @param	statsLog	unsigned long long		The step of the stats log
+		 * @param	quitStep	unsigned long long		The amount of steps after which the program quits
+		 * @return				unsigned long long
+		 */
+		unsigned long long getNextStatsLog(unsigned long long statsLog, unsigned long long quitStep) const;
+
+		/**
+		 * Returns the share of one worker in an amount of steps taken by all workers
+		 * @param	steps		unsigned long long		The steps of all workers
+		 * @param	worker		int						The number of the worker
+		 * @param	workers		int						The amount of workers
+		 * @return				unsigned long long
+		 */
+		static unsigned long long getWorkerShare(unsigned long long steps, int worker, int workers);
+
+		/**
+		 * Converts the policies between the csv and the binary format without running a simulation.
+		 * A csv file is imported into POLICIES_FILE first, then POLICIES_FILE is exported to a csv file
+		 * @param	importFile	std::string				The csv file to import, empty to skip
+		 * @param	exportFile	std::string				The csv file to export to, empty to skip
+		 * @param	tableType	StateTable::Type		The state table used in between
+		 * @param	encoding	PolicyFile::Encoding	How the values are stored in POLICIES_FILE
+		 * @return				void
+		 */
+		static void convertPolicies(const std::string &importFile, const std::string &exportFile, StateTable::Type tableType, PolicyFile::Encoding encoding);
 
 		/**
 		 * The main shutdown hook
@@ -166,7 +368,7 @@ class PinballBot{
 		std::string logAmountOfStates();
 
 		/**
-		 * Logs the average time per loop
+		 * Logs the average wall time per step since the last stats log, in microseconds
 		 * @return		std::string
 		 */
 
@@ -200,6 +402,92 @@ class PinballBot{
 
 		std::string logScore();
 
+		/**
+		 * Logs the average amount of heap allocations made by one observe, lookup, select and update cycle
+		 * @return		std::string
+		 */
+
+		std::string logAllocationsPerDecision();
+
+		/**
+		 * Logs how many physics steps were taken per decision of the agent
+		 * @return		std::string
+		 */
+
+		std::string logStepsPerDecision();
+
+		/**
+		 * Summarizes what the profilers recorded since the last stats log into phaseSummaries
+		 * @return		void
+		 */
+
+		void summarizePhases();
+
+		/**
+		 * Logs how long taking the last policy snapshot blocked the simulation
+		 * @return		std::string
+		 */
+
+		std::string logSnapshotPause();
+
+		/**
+		 * Logs how long writing the last policy snapshot took in the background
+		 * @return		std::string
+		 */
+
+		std::string logPolicyWriteDuration();
+
+		/**
+		 * Logs how many states the last policy checkpoint stored
+		 * @return		std::string
+		 */
+
+		std::string logPolicyCheckpointRows();
+
+		/**
+		 * Logs how many states were evicted to stay within the memory budget so far
+		 * @return		std::string
+		 */
+
+		std::string logStatesEvicted();
+
+		/**
+		 * Logs how long the longest slice of the last eviction pass locked the state table
+		 * @return		std::string
+		 */
+
+		std::string logEvictionSlice();
+
+#ifndef PINBALLBOT_HEADLESS
+		/**
+		 * Logs how many frames were recorded so far
+		 * @return		std::string
+		 */
+
+		std::string logRecordedFrames();
+
+		/**
+		 * Logs how many frames were dropped so far because the encoder fell behind
+		 * @return		std::string
+		 */
+
+		std::string logDroppedFrames();
+
+		/**
+		 * Logs how long rendering and copying a frame took the recorded worker on average, in milliseconds
+		 * @return		std::string
+		 */
+
+		std::string logRecordDuration();
+
+		/**
+		 * Logs how long encoding a frame took the background thread on average, in milliseconds
+		 * @return		std::string
+		 */
+
+		std::string logEncodeDuration();
+#endif
+
 };
 
 #endif /* PINBALLBOT_H_ */
@@ -9,11 +9,16 @@
 #include <math.h>
 #include <cmath>
 #include <stdio.h>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <algorithm>
 #include <iostream>
+#include <functional>
+#include <utility>
+#include <limits>
+#include <memory>
 
 #include <Box2D/Box2D.h>
 
@@ -21,6 +26,9 @@
 
 #include "../PinballBot.h"
 #include "State.h"
+#include "ValueKernels.h"
+#include "PolicyFile.h"
+#include "PolicyCSV.h"
 #include "../action/Action.h"
 
 const int					Agent::DEFAULT_STATES_TO_BACKPORT		= 40;
@@ -38,55 +46,108 @@ const std::string Agent::POLICIES_HEADER_POSITION_Y		= "POSITION_Y";
 const std::string Agent::POLICIES_HEADER_VELOCITY_X		= "VELOCITY_X";
 const std::string Agent::POLICIES_HEADER_VELOCITY_Y		= "VELOCITY_Y";
 
-const int Agent::POLICIES_HEADER_ACTIONS_OFFSET			= 4;
 const std::string Agent::POLICIES_HEADER_ACTION_PREFIX = "ACTION_";
 
+//compact once the deltas hold more states than this fraction of the table, replaying them would outgrow loading a base
+const float Agent::POLICIES_COMPACTION_RATIO			= 0.5f;
+
 Agent::Agent(
 		int							statesToBackport,
 		float						valueAdjustFraction,
 		float						epsilon,
 		std::vector<Action*>		availableActions,
 		unsigned long long			stepsUntilMinEpsilon,
-		bool						dynamicEpsilon
+		bool						dynamicEpsilon,
+		StateTable::Type			tableType,
+		StateTable::Grid			denseGrid,
+		float						traceDecay,
+		uint64_t					seed
 	):
 
 		STATES_TO_BACKPORT			(statesToBackport),
+		TRACE_DECAY					(traceDecay),
 		VALUE_ADJUST_FRACTION		(valueAdjustFraction),
 		EPSILON						(epsilon),
 		STEPS_UNTIL_MIN_EPSILON		(stepsUntilMinEpsilon),
 		DYNAMIC_EPSILON				(dynamicEpsilon),
+		SEED						(seed),
 		availableActions			(availableActions),
-		generator					(seed())
+		generator					(Seeds::derive(seed, Seeds::AGENT, 0)),
+		ownedStates					(new StateTable(availableActions.size(), tableType, denseGrid)),
+		rowValues					(availableActions.size()),
+		lastSnapshotPause			(-1),
+		policyEncoding				(PolicyFile::FLOAT32),
+		policyGeneration			(0),
+		policyCompactionRequired	(true),
+		policyDeltaRows				(0),
+		lastCheckpointRows			(-1),
+		evictor						(new StateEvictor(*ownedStates)),
+		tableReader					(-1),
+		states						(*ownedStates),
+		lastActions					(statesToBackport > 0 ? statesToBackport : 0, traceDecay),
+		policyWriter				(std::bind(&Agent::writePoliciesToFile, this, std::placeholders::_1))
 	{
 
-	printf("Starting agent with STATES_TO_BACKPORT: %d, VALUE_ADJUST_FRACTION: %f, EPSILON: %f\n", STATES_TO_BACKPORT, VALUE_ADJUST_FRACTION, EPSILON);
+	printf("Starting agent with STATES_TO_BACKPORT: %d (%lu above the minimum trace), TRACE_DECAY: %f, VALUE_ADJUST_FRACTION: %f, EPSILON: %f, SEED: %llu, value kernels: %s\n",
+			STATES_TO_BACKPORT, lastActions.capacity(), TRACE_DECAY, VALUE_ADJUST_FRACTION, EPSILON, (unsigned long long) SEED, ValueKernels::getInstructionSet());
 
 	//causes an std::bad_alloc on some systems
 	//states.reserve(std::pow(2, 20));//reserves a lot a space, enough space for 2^20 = 1'048'576 elements
 
 	loadPolicyFromFile();
+
+	tableReader = states.registerReader();
+
+	printf("Using a %s state table with %lu states, estimated memory usage: %.2f MB\n",
+			StateTable::getTypeName(states.getType()).c_str(), states.size(), states.getMemoryUsage() / (1024.0 * 1024.0));
 }
 
-void Agent::think(State state, std::vector<float> collectedRewards, unsigned long long steps){
+Agent::Agent(Agent &master, std::vector<Action*> availableActions, int worker):
 
-	int		currentStateIndex	= 0, lastActionIndex = lastActions.size()-1;
-	float	lastValue = Action::DEFAULT_REWARD;
+		STATES_TO_BACKPORT			(master.STATES_TO_BACKPORT),
+		TRACE_DECAY					(master.TRACE_DECAY),
+		VALUE_ADJUST_FRACTION		(master.VALUE_ADJUST_FRACTION),
+		EPSILON						(master.EPSILON),
+		STEPS_UNTIL_MIN_EPSILON		(master.STEPS_UNTIL_MIN_EPSILON),
+		DYNAMIC_EPSILON				(master.DYNAMIC_EPSILON),
+		SEED						(master.SEED),
+		availableActions			(availableActions),
+		generator					(Seeds::derive(master.SEED, Seeds::AGENT, worker)),
+		ownedStates					(nullptr),
+		rowValues					(availableActions.size()),
+		lastSnapshotPause			(-1),
+		policyEncoding				(PolicyFile::FLOAT32),
+		policyGeneration			(0),
+		policyCompactionRequired	(true),
+		policyDeltaRows				(0),
+		lastCheckpointRows			(-1),
+		evictor						(nullptr),
+		tableReader					(-1),
+		states						(master.states),
+		lastActions					(master.STATES_TO_BACKPORT > 0 ? master.STATES_TO_BACKPORT : 0, master.TRACE_DECAY),
+		policyWriter				(std::bind(&Agent::writePoliciesToFile, this, std::placeholders::_1))
+	{
 
-	//first check whether this state already occurred or not and retrieve the iterator
-	std::vector<State>::iterator it = std::lower_bound(states.begin(), states.end(), state);
-	currentStateIndex = (it - states.begin());
+	tableReader = states.registerReader();
+}
 
-	if(currentStateIndex >= states.size() || states[currentStateIndex] != state){
-		//If its a new state, add it at the *right* position to prevent a sort
-		it = states.insert(it, state);
+Agent::~Agent(){
+	//the last snapshot has to be written while the reader slot and everything else writePoliciesToFile() uses still exist
+	policyWriter.flush();
 
-		//As we inserted an element we need to increase the index of all after the new one
-		for(int i=0;i<lastActions.size();i++){
-			if(lastActions[i].first >= currentStateIndex){
-				lastActions[i].first++;
-			}
-		}
-	}
+	states.unregisterReader(tableReader);
+}
+
+void Agent::think(const State &state, const std::vector<float> &collectedRewards, unsigned long long steps){
+
+	int		currentStateIndex	= 0;
+
+	//the evictor may reuse the slots of states this agent doesn't hold in lastActions anymore
+	states.quiesce(tableReader, lastActions.capacity());
+
+	//first check whether this state already occurred, if not it's appended. Indices never move, so lastActions stays valid
+	currentStateIndex = states.findOrInsert(state);
+	states.visit(currentStateIndex);
 
 	/*
 	 * Maybe (actually most of the time in a pinball game) the good/bad reward isn't simply caused by the last action taken
@@ -102,63 +163,33 @@ void Agent::think(State state, std::vector<float> collectedRewards, unsigned lon
 	 * We now want to apply the reward received in state 15 to the actions taken in the last few steps
 	 */
 
-	if(lastActionIndex != -1){
-
-		lastValue = states[lastActions[lastActionIndex].first].getValue(lastActions[lastActionIndex].second);
-	}
-
 	//Appply the rewards
 	if(collectedRewards.size() != 0){
 
-		for(int i=0;i<lastActions.size();i++){
-
-			lastValue = states[lastActions[i].first].getValue(lastActions[i].second);
-
-			//printf("%lu rewards were collected:\n", collectedRewards.size());
-
-			//Apply all collected rewards, they can't be simply added up because then values greater than 1.0f would be possible
-			for(int j=0;j<collectedRewards.size();j++){
-
-				/* As currently we don't know more than that what we did in the last state and what the result is, we create a "connection" between the action and the reward
-				 * If we receive a good reward (1.0f) the epsilonGreedy() function is more likely to select this action in exactly this state again
-				 */
-
-				//printf("    %f adjusts the value by %f. Current value: %f\n", collectedRewards[j], ((VALUE_ADJUST_FRACTION) * (collectedRewards[j] - lastValue)),  lastValue + ((VALUE_ADJUST_FRACTION) * (collectedRewards[j] - lastValue)));
-
-				lastValue = lastValue + ((VALUE_ADJUST_FRACTION) * (collectedRewards[j] - lastValue));
-			}
-
-			//And last but not least converge the value of the state before to the average of the current state
-			lastValue = lastValue + ((VALUE_ADJUST_FRACTION) * (state.getGeneralValue() - lastValue));
-
-			states[lastActions[i].first].setValue(lastActions[i].second, lastValue);
-
-
-			//printf("The current value for %s is %f.\n", lastActions[i].second->getUID(), lastValue);
-		}
-
+		//taken before any row is adjusted, the current state may be one of the last states as well
+		float currentGeneralValue = states.getGeneralValue(currentStateIndex);
+
+		/* Apply all collected rewards, they can't be simply added up because then values greater than 1.0f would be possible
+		 * As currently we don't know more than that what we did in the last state and what the result is, we create a "connection" between the action and the reward
+		 * If we receive a good reward (1.0f) the epsilonGreedy() function is more likely to select this action in exactly this state again
+		 * And last but not least converge the value of the state before to the average of the current state
+		 *
+		 * The older an action, the less it's adjusted (see TRACE_DECAY)
+		 */
+		lastActions.backup(states, collectedRewards.data(), collectedRewards.size(), VALUE_ADJUST_FRACTION, currentGeneralValue);
 	}
 
 	//then decide what action to take next
 
-	Action* actionToTake;
+	int actionToTake;
 
-	actionToTake = this->epsilonGreedy(states[currentStateIndex], getEpsilon(steps));
+	actionToTake = this->epsilonGreedy(currentStateIndex, getEpsilon(steps));
 
 	//and the JUST DO IT
-	actionToTake->run();
-
-	lastActions.push_back(std::make_pair(currentStateIndex, actionToTake));
+	availableActions[actionToTake]->run();
 
-	if(lastActions.size() > STATES_TO_BACKPORT){
-		for(int i=0;i<(lastActions.size() - STATES_TO_BACKPORT);i++){
-			lastActions.pop_front();
-		}
-	}
-}
-
-unsigned Agent::seed(){
-	return (unsigned) std::chrono::system_clock::now().time_since_epoch().count();
+	//the trace buffer drops the oldest action once STATES_TO_BACKPORT are stored
+	lastActions.push(currentStateIndex, actionToTake);
 }
 
 float Agent::randomFloatInRange(const float &min, const float &max){
@@ -190,72 +221,54 @@ int Agent::randomIntInRange(const int &min, const int &max){
 	}
 }*/
 
-Action* Agent::epsilonGreedy(State state, const float &epsilon){
+int Agent::epsilonGreedy(int stateIndex, const float &epsilon){
 
 	if(epsilon < randomFloatInRange(0.0f, 1.0f)){
 		//pick a greedy action
-		return greedy(state);
+		return greedy(stateIndex);
 	}else{
 		//pick a random action
-		return random(availableActions);
+		return random(availableActions.size());
 	}
 }
 
-Action* Agent::greedy(State state){
-	float					maxValue = 0;
-	float					tmpValue;
-	std::vector<Action*>	maxActions;
+int Agent::greedy(int stateIndex){
+	float					*values = rowValues.data();
 
-	for(int i=0;i<availableActions.size();i++){
-		tmpValue		= state.getValue(availableActions[i]);
+	states.copyValues(stateIndex, values);
 
-		if(tmpValue > maxValue){
-			maxValue = tmpValue;
+	//values below zero are never picked over zero
+	float					maxValue	= ValueKernels::max(values, availableActions.size(), 0.0f);
+	int						maxActions	= ValueKernels::countEqual(values, availableActions.size(), maxValue);
 
-			maxActions.clear();
-			maxActions.push_back(availableActions[i]);
-		}else if(tmpValue == maxValue){
-			maxActions.push_back(availableActions[i]);
-		}
+	if(maxActions == 0){
+		return 0;
 	}
 
-	if(maxActions.size() == 1){
-		return maxActions[0];
-	}else{
-		return random(maxActions);
-	}
+	//pick one of the actions sharing the highest value at random
+	int pick = maxActions == 1 ? 0 : random(maxActions);
+
+	return ValueKernels::findEqual(values, availableActions.size(), maxValue, pick);
 }
 
-Action* Agent::random(std::vector<Action*> availableActions){
-	return availableActions[randomIntInRange(0, availableActions.size()-1)];
+int Agent::random(int actionCount){
+	return randomIntInRange(0, actionCount-1);
 }
 
 
 void Agent::clearStates(){
 
-	std::vector<int> indiciesToRemove(0);
-
-	for(int i=0;i<states.size();i++){
-		bool remove = true;
-
+	states.removeIf([this](int index){
+		const float *values = states.getValues(index);
 
-		for(auto const &iter : states[i].values){
-			if(iter.second != Action::DEFAULT_REWARD){
-				remove = false;
-				break;
+		for(int i=0;i<states.getActionCount();i++){
+			if(values[i] != Action::DEFAULT_REWARD){
+				return false;
 			}
 		}
 
-		if(remove){
-			indiciesToRemove.push_back(i);
-		}
-	}
-
-	std::sort(indiciesToRemove.begin(), indiciesToRemove.end());
-
-	for(int i=(indiciesToRemove.size() - 1);i >= 0;i--){
-		states.erase(states.begin() + indiciesToRemove[i]);
-	}
+		return true;
+	});
 
 	lastActions.clear();
 
@@ -290,107 +303,173 @@ float Agent::getEpsilon(unsigned long long steps){
 void Agent::savePoliciesToFile(){
 
 	if(states.size() != 0){
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
 
-		std::ofstream policies;
-		policies.open(PinballBot::POLICIES_FILE);
+		StateTable::Snapshot snapshot = states.snapshot(true);
 
-		//Generate header
-		policies << POLICIES_HEADER_POSITION_X << ";" << POLICIES_HEADER_POSITION_Y << ";" << POLICIES_HEADER_VELOCITY_X << ";" << POLICIES_HEADER_VELOCITY_Y;
-		for(int i=0;i<availableActions.size();i++){
-			policies << ";" << POLICIES_HEADER_ACTION_PREFIX << availableActions[i]->getUID();
-		}
-		policies << std::endl;
+		lastSnapshotPause = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+
+		policyWriter.submit(std::move(snapshot));
+	}
+}
 
-		//and the content in the same order
+void Agent::flushPolicies(){
+	policyWriter.flush();
+}
 
-		for(int i=0;i<states.size();i++){
-			policies << states[i].ballPosition_x << ";" << states[i].ballPosition_y << ";"
-								<< states[i].ballVelocity_x << ";" << states[i].ballVelocity_y;
+double Agent::getSnapshotPause() const{
+	return lastSnapshotPause;
+}
 
-			for(int j=0;j<availableActions.size();j++){
+double Agent::getWriteDuration() const{
+	return policyWriter.getLastWriteDuration();
+}
 
-				if(states[i].values.find(availableActions[j]) == states[i].values.end()){
-					policies << ";" << Action::DEFAULT_REWARD;
-					//printf("DEFAULT Value: %f\n", Action::DEFAULT_REWARD);
-				}else{
-					policies << ";" << (states[i].getValue(availableActions[j]));
-					//printf("Value: %f\n", (states[i].getValue(availableActions[j])));
-				}
-			}
+long Agent::getCheckpointRows() const{
+	return lastCheckpointRows.load();
+}
 
-			policies << std::endl;
+void Agent::setPolicyEncoding(PolicyFile::Encoding encoding){
+	policyEncoding = encoding;
+}
+
+void Agent::setMaxTableMemory(size_t bytes){
+	if(evictor){
+		evictor->setMaxMemory(bytes);
+	}
+}
+
+unsigned long long Agent::getEvictedStates() const{
+	return evictor ? evictor->getEvictedStates() : 0;
+}
+
+double Agent::getEvictionSlice() const{
+	return evictor ? evictor->getLastSliceDuration() : -1;
+}
+
+void Agent::writePoliciesToFile(const StateTable::Snapshot &snapshot){
+	const std::vector<int> &dirty = snapshot.getDirty();
+
+	//the dirty states don't describe all changes after clear() or removeIf()
+	if(policyCompactionRequired || snapshot.isReindexed()
+			|| policyDeltaRows + dirty.size() > POLICIES_COMPACTION_RATIO * snapshot.size()){
+
+		if(PolicyFile::write(PinballBot::POLICIES_FILE, snapshot, availableActions, policyEncoding, policyGeneration + 1)){
+			//the deltas are part of the new base, they'd be skipped by their generation even if removing them fails
+			std::remove(PinballBot::POLICIES_DELTA_FILE.c_str());
+
+			policyGeneration++;
+			policyCompactionRequired	= false;
+			policyDeltaRows				= 0;
+
+			lastCheckpointRows.store(snapshot.size());
+		}else{
+			policyCompactionRequired	= true;
+		}
+	}else{
+		if(!dirty.empty() && PolicyFile::append(PinballBot::POLICIES_DELTA_FILE, snapshot, availableActions, policyEncoding, policyGeneration)){
+			policyDeltaRows += dirty.size();
+		}else if(!dirty.empty()){
+			//the changes are lost unless the next checkpoint stores everything
+			policyCompactionRequired = true;
 		}
+
+		lastCheckpointRows.store(dirty.size());
 	}
 }
 
-void Agent::loadPolicyFromFile(){
-	std::string					line, header;
-	std::ifstream				policies;
-	std::vector<std::string>	partials, headerPartials;
+void Agent::exportPoliciesToCSV(const std::string &file){
 
-	states.clear();
+	StateTable::Snapshot snapshot = states.snapshot();
 
-	printf("Reading and parsing %s....\n", PinballBot::POLICIES_FILE.c_str());
+	std::ofstream policies;
+	policies.open(file);
 
-	policies.open(PinballBot::POLICIES_FILE);
+	//enough digits to read back the exact same floats
+	policies.precision(std::numeric_limits<float>::max_digits10);
 
-	if(std::getline(policies, header)){
+	//Generate header
+	policies << POLICIES_HEADER_POSITION_X << ";" << POLICIES_HEADER_POSITION_Y << ";" << POLICIES_HEADER_VELOCITY_X << ";" << POLICIES_HEADER_VELOCITY_Y;
+	for(int i=0;i<availableActions.size();i++){
+		policies << ";" << POLICIES_HEADER_ACTION_PREFIX << availableActions[i]->getUID();
+	}
+	policies << '\n';
 
-		split(header, ';', headerPartials);
+	//and the content in the same order, sorted by position and velocity
 
-		while (std::getline(policies, line)){
+	std::vector<int> sortedIndices = snapshot.sortedIndices();
 
-			bool	posX = false, posY = false, velX = false, velY = false;
-			State	state(0, 0, 0, 0, availableActions);
+	for(int k=0;k<sortedIndices.size();k++){
+		int i = sortedIndices[k];
 
-			split(line, ';', partials);
-			if(partials.size() != headerPartials.size()){
-				printf("ERROR: Line %lu of %s doesn't have the same amount of columns as the header!\n", (states.size() + 1), PinballBot::POLICIES_FILE.c_str());
-				break;
-			}
+		policies << snapshot[i].ballPosition_x << ";" << snapshot[i].ballPosition_y << ";"
+							<< snapshot[i].ballVelocity_x << ";" << snapshot[i].ballVelocity_y;
 
-			for(int i=0;i<partials.size();i++){
-
-				if(headerPartials[i] == POLICIES_HEADER_POSITION_X){
-					state.ballPosition_x	= stoi(partials[i]);
-					posX					= true;
-				}else if(headerPartials[i] == POLICIES_HEADER_POSITION_Y){
-					state.ballPosition_y	= stoi(partials[i]);
-					posY					= true;
-				}else if(headerPartials[i] == POLICIES_HEADER_VELOCITY_X){
-					state.ballVelocity_x	= stoi(partials[i]);
-					velX					= true;
-				}else if(headerPartials[i] == POLICIES_HEADER_VELOCITY_Y){
-					state.ballVelocity_x	= stoi(partials[i]);
-					velY					= true;
-				}else{
-					for(int j=0; j<availableActions.size(); j++){
-						if(headerPartials[i] == (POLICIES_HEADER_ACTION_PREFIX + std::string(availableActions[j]->getUID()))){
-							state.values[availableActions[j]] = stoi(partials[POLICIES_HEADER_ACTIONS_OFFSET + j]);
-						}
-					}
-				}
-			}
+		const float *values = snapshot.getValues(i);
+
+		for(int j=0;j<availableActions.size();j++){
+			policies << ";" << values[j];
+		}
+
+		policies << '\n';
+	}
+}
+
+void Agent::loadPolicyFromFile(){
+	states.clear();
+
+	std::chrono::steady_clock::time_point	started	= std::chrono::steady_clock::now();
+	long									loaded	= PolicyFile::load(PinballBot::POLICIES_FILE, states, availableActions, policyGeneration);
 
-			// push new state to states if all values are loaded
-			if(posX && posY && velX && velY){
-				states.push_back(state);
+	if(loaded >= 0){
+		long replayed = PolicyFile::replay(PinballBot::POLICIES_DELTA_FILE, states, availableActions, policyGeneration);
+
+		printf("Loaded %ld states from %s and %ld changed ones from %s in %.1f ms\n",
+				loaded, PinballBot::POLICIES_FILE.c_str(), std::max(replayed, 0L), PinballBot::POLICIES_DELTA_FILE.c_str(),
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+
+		//the table matches the files now, the next checkpoint continues the log
+		states.clearDirty();
+
+		policyCompactionRequired	= false;
+		policyDeltaRows				= std::max(replayed, 0L);
+	}else{
+		//a file that exists but was rejected would be overwritten by the next checkpoint, so it's moved aside with its deltas
+		if(std::ifstream(PinballBot::POLICIES_FILE).good()){
+			std::string bad = PinballBot::POLICIES_FILE + ".bad";
+
+			if(std::rename(PinballBot::POLICIES_FILE.c_str(), bad.c_str()) != 0){
+				printf("ERROR: Couldn't move the rejected %s aside, quitting instead of overwriting it!\n", PinballBot::POLICIES_FILE.c_str());
+				exit(1);
 			}
 
-			partials.clear();
+			std::rename(PinballBot::POLICIES_DELTA_FILE.c_str(), (PinballBot::POLICIES_DELTA_FILE + ".bad").c_str());
+
+			printf("ERROR: Moved the rejected %s to %s, starting from %s instead\n",
+					PinballBot::POLICIES_FILE.c_str(), bad.c_str(), PinballBot::POLICIES_CSV_FILE.c_str());
 		}
+
+		//policies of older versions only exist as csv
+		states.clear();
+		importPoliciesFromCSV(PinballBot::POLICIES_CSV_FILE);
 	}
+}
+
+void Agent::importPoliciesFromCSV(const std::string &file){
+	states.clear();
 
-	printf("Read and parsed %s, %lu states were imported.\n", PinballBot::POLICIES_FILE.c_str(), states.size());
+	printf("Reading and parsing %s....\n", file.c_str());
 
-	return;
-}
+	std::chrono::steady_clock::time_point	started	= std::chrono::steady_clock::now();
+	size_t									bytes	= 0;
+	long									lines	= PolicyCSV::load(file, states, availableActions, bytes);
+	double									seconds	= std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
 
-std::vector<std::string> Agent::split(const std::string &s, char delim, std::vector<std::string> &elems) {
-	std::stringstream ss(s);
-	std::string item;
-	while (std::getline(ss, item, delim)) {
-		elems.push_back(item);
+	if(lines < 0){
+		printf("Couldn't read %s, no states were imported.\n", file.c_str());
+		return;
 	}
-	return elems;
+
+	printf("Read and parsed %s, %lu states were imported in %.2f s (%.1f MB/s, %.0f rows/s).\n",
+			file.c_str(), states.size(), seconds, bytes / (1024.0 * 1024.0) / seconds, lines / seconds);
 }
@@ -9,12 +9,20 @@
 
 #include <vector>
 #include <string>
-#include <deque>
 #include <iostream>
+#include <atomic>
+#include <memory>
+#include <cstdint>
 
 #include <Box2D/Box2D.h>
 
 #include "State.h"
+#include "StateTable.h"
+#include "TraceBuffer.h"
+#include "PolicyWriter.h"
+#include "PolicyFile.h"
+#include "StateEvictor.h"
+#include "Seeds.h"
 #include "../action/Action.h"
 
 class Agent{
@@ -36,27 +44,56 @@ class Agent{
 		static const std::string			POLICIES_HEADER_VELOCITY_X;
 		static const std::string			POLICIES_HEADER_VELOCITY_Y;
 
-		static const int					POLICIES_HEADER_ACTIONS_OFFSET;
 		static const std::string			POLICIES_HEADER_ACTION_PREFIX;
 
+		static const float					POLICIES_COMPACTION_RATIO;
+
 
 		const int							STATES_TO_BACKPORT;
+		const float							TRACE_DECAY;
 		const float							VALUE_ADJUST_FRACTION;
 		const float							EPSILON;
 
 		const unsigned long long			STEPS_UNTIL_MIN_EPSILON;
 		const bool							DYNAMIC_EPSILON;
 
+		//the seed of the run, the generators of the agent and its workers are derived from it
+		const uint64_t						SEED;
+
 	private:
 
 		std::vector<Action*>				availableActions;
 		std::default_random_engine			generator;
 
-		/**
-		 * Generates a seed.
-		 * @return	void
-		 */
-		static unsigned seed();
+		//the table of an agent that doesn't share one with others, nullptr for workers, see the worker constructor
+		std::unique_ptr<StateTable>			ownedStates;
+
+		//scratch copy of the row greedy() decides on, other agents may update the row meanwhile
+		std::vector<float>					rowValues;
+
+		//how long taking the last snapshot blocked the caller of savePoliciesToFile(), in milliseconds
+		double								lastSnapshotPause;
+
+		//how the values are stored in POLICIES_FILE
+		PolicyFile::Encoding				policyEncoding;
+
+		//the generation of the base in POLICIES_FILE, the delta checkpoints in POLICIES_DELTA_FILE belong to it
+		uint64_t							policyGeneration;
+
+		//whether the next checkpoint has to be a full one, e.g. if there's no base yet or a delta couldn't be written
+		bool								policyCompactionRequired;
+
+		//the amount of states stored in POLICIES_DELTA_FILE since the base was written
+		size_t								policyDeltaRows;
+
+		//the amount of states the last checkpoint stored, -1 if nothing was written yet
+		std::atomic<long>					lastCheckpointRows;
+
+		//keeps ownedStates within the budget set by setMaxTableMemory(), nullptr for workers as they share the one of their master
+		std::unique_ptr<StateEvictor>		evictor;
+
+		//the reader slot of this agent in states, the indices in lastActions are only reused after it moved on
+		int									tableReader;
 
 		/**
 		 * Generates a pseudo-random float
@@ -84,31 +121,50 @@ class Agent{
 
 		/**
 		 * Returns one state inside of a vector based on a epsilon greedy algorithm
-		 * @param	state		State					A state containing all the possible actions
+		 * @param	stateIndex	int						The index of the state inside of states
 		 * @param	epsilon		float					Range: [0-1]: The percentage of time which this function should pick a random state
-		 * @return				Action					The picked action
+		 * @return				int						The ordinal of the picked action inside of availableActions
 		 */
-		Action* epsilonGreedy(State state, const float &epsilon);
+		int epsilonGreedy(int stateIndex, const float &epsilon);
 
 		/**
 		 * Picks the state with the highest value
-		 * @param	state		State					A state containing all the possible actions
-		 * @return				Action					The picked action
+		 * @param	stateIndex	int						The index of the state inside of states
+		 * @return				int						The ordinal of the picked action inside of availableActions
 		 */
-		Action* greedy(State state);
+		int greedy(int stateIndex);
+
+		/**
+		 * Writes a checkpoint of the states in the binary format, runs on the writer thread. Only the states changed since
+		 * the last checkpoint are appended to POLICIES_DELTA_FILE, unless the deltas grew beyond POLICIES_COMPACTION_RATIO
+		 * of the table: then they're compacted into a new base in POLICIES_FILE
+		 * @param	snapshot	StateTable::Snapshot	The snapshot to write, taken with takeDirty
+		 * @return				void
+		 */
+		void writePoliciesToFile(const StateTable::Snapshot &snapshot);
 
 		/**
 		 * Picks a random state
-		 * @param	states		std::vector<Action*>	A vector containing all the possible actions
-		 * @return				Action					The picked action
+		 * @param	actionCount	int						The amount of possible actions
+		 * @return				int						The ordinal of the picked action
 		 */
-		Action* random(std::vector<Action*> availableActions);
+		int random(int actionCount);
 
 	public:
 
-		std::vector<State>					states;
+		//either ownedStates or the table of the agent this one was created for
+		StateTable							&states;
+
+		//the last actions taken, a reward is backported to all of them
+		TraceBuffer							lastActions;
+
+	private:
+
+		//writes the snapshots taken by savePoliciesToFile() in the background. Declared last so it's destroyed first:
+		//its thread still writes the last snapshot with the policy generation, the delta rows and the table
+		PolicyWriter						policyWriter;
 
-		std::deque<std::pair<int, Action*>>	lastActions;
+	public:
 
 		/**
 		 * Inits the Agent class
@@ -116,6 +172,10 @@ class Agent{
 		 * @param	valueAdjustFraction	float					The fraction of the difference that will be added to the value
 		 * @param	epsilon				float					The chance the agent will choose an action at random; range: [0.0 - 1.0]
 		 * @param	availableActions	std::vector<Action*>	The actions available to the agent
+		 * @param	tableType			StateTable::Type		Whether the states are stored in a hash index or a preallocated dense index
+		 * @param	denseGrid			StateTable::Grid		The grid covered by the dense index
+		 * @param	traceDecay			float					The factor a backported reward shrinks with per state, 1.0 = no decay
+		 * @param	seed				uint64_t				The seed of the run, see Seeds
 		 */
 		Agent(
 				int						statesToBackport		= DEFAULT_STATES_TO_BACKPORT,
@@ -123,9 +183,28 @@ class Agent{
 				float					epsilon					= DEFAULT_EPSILON,
 				std::vector<Action*>	availableActions		= std::vector<Action*>(0),
 				unsigned long long		stepsUntilMinEpsilon	= DEFAULT_STEPS_UNTIL_MIN_EPSILON,
-				bool					dynamicEpsilon			= DEFAULT_DYNAMIC_EPSILON
+				bool					dynamicEpsilon			= DEFAULT_DYNAMIC_EPSILON,
+				StateTable::Type		tableType				= StateTable::SPARSE,
+				StateTable::Grid		denseGrid				= StateTable::Grid(),
+				float					traceDecay				= TraceBuffer::DEFAULT_DECAY,
+				uint64_t				seed					= Seeds::fromClock()
 		);
 
+		/**
+		 * Inits a worker agent: it learns into the state table of another agent using its parameters,
+		 * but acts on its own simulation and has its own traces and random number generator.
+		 * Nothing is loaded from or saved to the policies file, that's left to the other agent
+		 * @param	master				Agent					The agent owning the state table
+		 * @param	availableActions	std::vector<Action*>	The actions available to the worker, in the same order as the ones of master
+		 * @param	worker				int						The number of the worker, every worker draws from its own stream of master.SEED
+		 */
+		Agent(Agent &master, std::vector<Action*> availableActions, int worker);
+
+		/**
+		 * Waits for the policy writer and releases the reader slot of the agent
+		 */
+		~Agent();
+
 		/**
 		 * Based on a given state the agent needs to decide what to do
 		 * @param	state		State		The given state
@@ -133,7 +212,7 @@ class Agent{
 		 * @param	steps		int			The amount of steps until this moment
 		 * @return				void
 		 */
-		void think(State state, std::vector<float> collectedRewards, unsigned long long steps);
+		void think(const State &state, const std::vector<float> &collectedRewards, unsigned long long steps);
 
 		/**
 		 * Clears "useless" (all values = default)
@@ -148,25 +227,83 @@ class Agent{
 		float getEpsilon(unsigned long long steps);
 
 		/**
-		 * Saves the policy to a file
+		 * Saves the policy to a file. Only a snapshot is taken right away, it's written on a background thread.
+		 * Usually only the states changed since the last save are written, see writePoliciesToFile()
 		 */
 
 		void savePoliciesToFile();
 
 		/**
-		 * Loads a policy file
+		 * Waits until all policies saved are written
+		 * @return				void
+		 */
+		void flushPolicies();
+
+		/**
+		 * Returns how long taking the last snapshot in savePoliciesToFile() blocked
+		 * @return				double		The duration in milliseconds, -1 if nothing was saved yet
+		 */
+		double getSnapshotPause() const;
+
+		/**
+		 * Returns how long writing the last snapshot took on the writer thread
+		 * @return				double		The duration in milliseconds, -1 if nothing was written yet
+		 */
+		double getWriteDuration() const;
+
+		/**
+		 * Returns the amount of states the last checkpoint stored, all of them if it was compacted into a new base
+		 * @return				long		The amount of states, -1 if nothing was written yet
+		 */
+		long getCheckpointRows() const;
+
+		/**
+		 * Sets how the values are stored by savePoliciesToFile()
+		 * @param	encoding	PolicyFile::Encoding	FLOAT32 or UINT16
+		 * @return				void
+		 */
+		void setPolicyEncoding(PolicyFile::Encoding encoding);
+
+		/**
+		 * Sets how much memory the state table may use, cold states are evicted in the background beyond that.
+		 * Evicted states are lost once the next checkpoint compacts the policies. Ignored by workers, the budget is the master's
+		 * @param	bytes		size_t		The budget in bytes, 0 = unlimited
+		 * @return				void
+		 */
+		void setMaxTableMemory(size_t bytes);
+
+		/**
+		 * Returns the amount of states evicted so far
+		 * @return				unsigned long long
+		 */
+		unsigned long long getEvictedStates() const;
+
+		/**
+		 * Returns how long the longest slice of the last eviction pass locked the table
+		 * @return				double		The duration in milliseconds, -1 if nothing was evicted yet
+		 */
+		double getEvictionSlice() const;
+
+		/**
+		 * Loads the binary base and replays the delta checkpoints written since, or imports POLICIES_CSV_FILE if there is no base.
+		 * A base that exists but is rejected is renamed to *.bad with its deltas first, so no checkpoint overwrites it
 		 */
 
 		void loadPolicyFromFile();
 
 		/**
-		* Breaks a String into partials beteen the delimiter
-		* @param	s		String			String to break down
-		* @param	delim	char			Deimiter between partials
-		* @param	elems	vector<string>	vector where strings are saved into
-		* @return			vector<string>
-		*/
-		std::vector<std::string> split(const std::string &s, char delim, std::vector<std::string> &elems);
+		 * Replaces all states by the ones of a csv file, the header names the actions of the columns
+		 * @param	file		std::string		The csv file to import
+		 * @return				void
+		 */
+		void importPoliciesFromCSV(const std::string &file);
+
+		/**
+		 * Writes all states to a csv file, synchronously
+		 * @param	file		std::string		The csv file to write
+		 * @return				void
+		 */
+		void exportPoliciesToCSV(const std::string &file);
 
 };
 
@@ -0,0 +1,133 @@
+/*
+ * KeyIndex.cpp
+ *
+ * Maps 64 bit keys to non-negative ints in one flat array (open addressing with linear probing),
+ * no node is allocated per key and inserting only reallocates when the array doubles
+ */
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "KeyIndex.h"
+
+static const size_t MIN_SLOTS = 16;
+
+KeyIndex::KeyIndex() : count(0), shift(64){
+}
+
+size_t KeyIndex::getSlot(uint64_t key) const{
+	//bit n of the product depends on all bits of the key up to n, so the top bits are the best mixed ones
+	return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> shift);
+}
+
+int KeyIndex::find(uint64_t key) const{
+	if(count == 0){
+		return -1;
+	}
+
+	size_t mask = values.size() - 1;
+
+	for(size_t slot = getSlot(key);values[slot] != -1;slot = (slot + 1) & mask){
+		if(keys[slot] == key){
+			return values[slot];
+		}
+	}
+
+	return -1;
+}
+
+void KeyIndex::insert(uint64_t key, int value){
+	//at most half of the slots are used, so probe sequences stay short
+	if((count + 1) * 2 > values.size()){
+		rehash(std::max(MIN_SLOTS, values.size() * 2));
+	}
+
+	size_t mask = values.size() - 1;
+	size_t slot = getSlot(key);
+
+	while(values[slot] != -1){
+		slot = (slot + 1) & mask;
+	}
+
+	keys[slot]		= key;
+	values[slot]	= value;
+	count++;
+}
+
+bool KeyIndex::erase(uint64_t key){
+	if(count == 0){
+		return false;
+	}
+
+	size_t mask = values.size() - 1;
+	size_t hole = getSlot(key);
+
+	while(values[hole] != -1 && keys[hole] != key){
+		hole = (hole + 1) & mask;
+	}
+
+	if(values[hole] == -1){
+		return false;
+	}
+
+	//a key may move back into the hole unless its probe sequence starts behind the hole
+	for(size_t slot = (hole + 1) & mask;values[slot] != -1;slot = (slot + 1) & mask){
+		size_t home = getSlot(keys[slot]);
+
+		if(((slot - home) & mask) >= ((slot - hole) & mask)){
+			keys[hole]		= keys[slot];
+			values[hole]	= values[slot];
+			hole			= slot;
+		}
+	}
+
+	values[hole] = -1;
+	count--;
+
+	return true;
+}
+
+void KeyIndex::rehash(size_t slots){
+	std::vector<uint64_t>	oldKeys;
+	std::vector<int>		oldValues;
+
+	oldKeys.swap(keys);
+	oldValues.swap(values);
+
+	keys.resize(slots);
+	values.assign(slots, -1);
+	shift = 64 - __builtin_ctzll(slots);
+	count = 0;
+
+	for(size_t i=0;i<oldValues.size();i++){
+		if(oldValues[i] != -1){
+			insert(oldKeys[i], oldValues[i]);
+		}
+	}
+}
+
+void KeyIndex::reserve(size_t amount){
+	size_t slots = MIN_SLOTS;
+
+	while(slots < amount * 2){
+		slots *= 2;
+	}
+
+	if(slots > values.size()){
+		rehash(slots);
+	}
+}
+
+void KeyIndex::clear(){
+	std::fill(values.begin(), values.end(), -1);
+	count = 0;
+}
+
+size_t KeyIndex::size() const{
+	return count;
+}
+
+size_t KeyIndex::getMemoryUsage() const{
+	return keys.capacity() * sizeof(uint64_t) + values.capacity() * sizeof(int);
+}
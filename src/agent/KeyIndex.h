@@ -0,0 +1,98 @@
+/*
+ * KeyIndex.h
+ *
+ * Maps 64 bit keys to non-negative ints in one flat array (open addressing with linear probing),
+ * no node is allocated per key and inserting only reallocates when the array doubles
+ */
+
+#ifndef AGENT_KEYINDEX_H_
+#define AGENT_KEYINDEX_H_
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class KeyIndex{
+
+	private:
+
+		std::vector<uint64_t>		keys;
+
+		//-1 marks an empty slot
+		std::vector<int>			values;
+
+		size_t						count;
+
+		//64 - log2(slots), the slot of a key are the top bits of its multiplicative hash
+		int							shift;
+
+		/**
+		 * Returns the slot a key starts probing at
+		 * @param	key		uint64_t
+		 * @return			size_t
+		 */
+		size_t getSlot(uint64_t key) const;
+
+		/**
+		 * Moves all keys into an array with a specific amount of slots
+		 * @param	slots	size_t		The new amount of slots, a power of two
+		 * @return			void
+		 */
+		void rehash(size_t slots);
+
+	public:
+
+		/**
+		 * Inits an empty index
+		 */
+		KeyIndex();
+
+		/**
+		 * Looks up a key
+		 * @param	key		uint64_t	The key to look for
+		 * @return			int			The value or -1 if the key isn't stored
+		 */
+		int find(uint64_t key) const;
+
+		/**
+		 * Stores a key that isn't stored yet
+		 * @param	key		uint64_t	The key to store
+		 * @param	value	int			The value, at least 0
+		 * @return			void
+		 */
+		void insert(uint64_t key, int value);
+
+		/**
+		 * Removes a key, the keys probing past it are shifted back so no tombstones are left behind
+		 * @param	key		uint64_t	The key to remove
+		 * @return			bool		Whether the key was stored
+		 */
+		bool erase(uint64_t key);
+
+		/**
+		 * Makes sure a specific amount of keys can be stored without reallocating
+		 * @param	amount	size_t		The amount of keys
+		 * @return			void
+		 */
+		void reserve(size_t amount);
+
+		/**
+		 * Removes all keys, the array stays allocated
+		 * @return			void
+		 */
+		void clear();
+
+		/**
+		 * Returns the amount of keys stored
+		 * @return			size_t
+		 */
+		size_t size() const;
+
+		/**
+		 * Returns the amount of memory allocated
+		 * @return			size_t		The amount of bytes
+		 */
+		size_t getMemoryUsage() const;
+};
+
+#endif /* AGENT_KEYINDEX_H_ */
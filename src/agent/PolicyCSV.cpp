@@ -0,0 +1,209 @@
+/*
+ * PolicyCSV.cpp
+ *
+ * Imports the policies.csv files written by older versions. The file is mapped into memory, split into ranges
+ * at line boundaries and every range is parsed on its own thread, the states are inserted in file order afterwards
+ */
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <thread>
+#include <algorithm>
+
+#include <sys/mman.h>
+
+#include "PolicyCSV.h"
+#include "PolicyFile.h"
+#include "Agent.h"
+#include "State.h"
+#include "StateTable.h"
+#include "../action/Action.h"
+
+const size_t PolicyCSV::MIN_RANGE_SIZE	= 1 << 20; //smaller files aren't worth starting threads for
+
+long PolicyCSV::load(const std::string &file, StateTable &states, const std::vector<Action*> &availableActions, size_t &bytes){
+	size_t		size	= 0;
+	const char	*data	= PolicyFile::map(file, size);
+
+	if(data == NULL){
+		return -1;
+	}
+
+	bytes = size;
+
+	const char	*end		= data + size;
+	const char	*headerEnd	= (const char*) std::memchr(data, '\n', size);
+
+	if(headerEnd == NULL){
+		headerEnd = end;
+	}
+
+	//resolve the header once, every line is parsed against it
+	std::vector<int>	columns;
+	int					stateColumns	= 0;
+
+	for(const char *cell = data; cell <= headerEnd;){
+		const char *cellEnd = std::find(cell, headerEnd, ';');
+		std::string name(cell, cellEnd);
+
+		if(!name.empty() && name.back() == '\r'){
+			name.pop_back();
+		}
+
+		int column = IGNORED;
+
+		if(name == Agent::POLICIES_HEADER_POSITION_X){
+			column = POSITION_X;
+		}else if(name == Agent::POLICIES_HEADER_POSITION_Y){
+			column = POSITION_Y;
+		}else if(name == Agent::POLICIES_HEADER_VELOCITY_X){
+			column = VELOCITY_X;
+		}else if(name == Agent::POLICIES_HEADER_VELOCITY_Y){
+			column = VELOCITY_Y;
+		}else{
+			for(int j=0;j<availableActions.size();j++){
+				if(name == Agent::POLICIES_HEADER_ACTION_PREFIX + availableActions[j]->getUID()){
+					column = j;
+				}
+			}
+		}
+
+		if(column <= POSITION_X){
+			stateColumns++;
+		}
+
+		columns.push_back(column);
+		cell = cellEnd + 1;
+	}
+
+	if(stateColumns != 4){
+		printf("ERROR: The header of %s doesn't name all four state columns!\n", file.c_str());
+		munmap((void*) data, size);
+		return -1;
+	}
+
+	//split the lines into one range per thread, every range starts right after a line break
+	const char		*body		= headerEnd < end ? headerEnd + 1 : end;
+	unsigned		threads		= std::max(1u, std::thread::hardware_concurrency());
+	size_t			rangeCount	= std::max((size_t) 1, std::min((size_t) threads, (size_t)(end - body) / MIN_RANGE_SIZE));
+
+	std::vector<Range> ranges(rangeCount);
+
+	for(size_t r=0;r<rangeCount;r++){
+		const char *begin = r == 0 ? body : ranges[r - 1].end;
+		const char *split = r == rangeCount - 1 ? end : std::max(begin, body + (end - body) / rangeCount * (r + 1));
+
+		if(split < end){
+			const char *lineBreak = (const char*) std::memchr(split, '\n', end - split);
+			split = lineBreak != NULL ? lineBreak + 1 : end;
+		}
+
+		ranges[r].begin		= begin;
+		ranges[r].end		= split;
+		ranges[r].lines		= 0;
+		ranges[r].malformed	= false;
+	}
+
+	std::vector<std::thread> parsers;
+
+	for(size_t r=1;r<rangeCount;r++){
+		parsers.push_back(std::thread(&PolicyCSV::parse, std::ref(ranges[r]), std::cref(columns), (int) availableActions.size()));
+	}
+
+	parse(ranges[0], columns, availableActions.size());
+
+	for(size_t t=0;t<parsers.size();t++){
+		parsers[t].join();
+	}
+
+	munmap((void*) data, size);
+
+	//insert in file order, so a state listed twice keeps its last values like before
+	long	imported	= 0;
+	size_t	line		= 1;
+
+	for(size_t r=0;r<rangeCount;r++){
+		Range &range = ranges[r];
+
+		states.reserve(states.size() + range.states.size());
+
+		for(size_t i=0;i<range.states.size();i++){
+			std::copy_n(&range.values[i * availableActions.size()], availableActions.size(), states.getValues(states.findOrInsert(range.states[i])));
+		}
+
+		imported	+= range.states.size();
+		line		+= range.lines;
+
+		if(range.malformed){
+			printf("ERROR: Line %lu of %s is malformed or doesn't have the same amount of columns as the header!\n", line + 1, file.c_str());
+			break;
+		}
+
+		//release the parsed lines early, they'd double the memory needed otherwise
+		range.states		= std::vector<State>();
+		range.values		= std::vector<float>();
+	}
+
+	return imported;
+}
+
+void PolicyCSV::parse(Range &range, const std::vector<int> &columns, int actionCount){
+	std::vector<float> values(actionCount);
+
+	for(const char *lineStart = range.begin; lineStart < range.end;){
+		const char *lineEnd		= (const char*) std::memchr(lineStart, '\n', range.end - lineStart);
+		const char *next		= lineEnd != NULL ? lineEnd + 1 : range.end;
+
+		if(lineEnd == NULL){
+			lineEnd = range.end;
+		}
+
+		if(lineEnd > lineStart && lineEnd[-1] == '\r'){
+			lineEnd--;
+		}
+
+		if(lineEnd == lineStart){
+			range.lines++;
+			lineStart = next;
+			continue;
+		}
+
+		State			state(0, 0, 0, 0);
+		const char		*cell		= lineStart;
+		bool			valid		= true;
+
+		std::fill(values.begin(), values.end(), Action::DEFAULT_REWARD);
+
+		for(size_t c=0;c<columns.size() && valid;c++){
+			const char				*cellEnd	= std::find(cell, lineEnd, ';');
+			std::from_chars_result	result		= {cell, std::errc()};
+
+			switch(columns[c]){
+				case POSITION_X:	result = std::from_chars(cell, cellEnd, state.ballPosition_x);	break;
+				case POSITION_Y:	result = std::from_chars(cell, cellEnd, state.ballPosition_y);	break;
+				case VELOCITY_X:	result = std::from_chars(cell, cellEnd, state.ballVelocity_x);	break;
+				case VELOCITY_Y:	result = std::from_chars(cell, cellEnd, state.ballVelocity_y);	break;
+				case IGNORED:		result.ptr = cellEnd;											break;
+				default:			result = std::from_chars(cell, cellEnd, values[columns[c]]);	break;
+			}
+
+			//every cell has to be consumed completely and only the last one may end the line
+			valid	= result.ec == std::errc() && result.ptr == cellEnd && (cellEnd < lineEnd) == (c + 1 < columns.size());
+			cell	= cellEnd + 1;
+		}
+
+		if(!valid){
+			range.malformed = true;
+			return;
+		}
+
+		range.states.push_back(state);
+		range.values.insert(range.values.end(), values.begin(), values.end());
+
+		range.lines++;
+		lineStart = next;
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * PolicyCSV.h
+ *
+ * Imports the policies.csv files written by older versions. The file is mapped into memory, split into ranges
+ * at line boundaries and every range is parsed on its own thread, the states are inserted in file order afterwards
+ *
+ * Layout: one header line naming the columns (POSITION_X, POSITION_Y, VELOCITY_X, VELOCITY_Y and ACTION_<uid>),
+ * then one line per state, all separated by ';'
+ */
+
+#ifndef AGENT_POLICYCSV_H_
+#define AGENT_POLICYCSV_H_
+
+#include <vector>
+#include <string>
+
+#include "State.h"
+#include "StateTable.h"
+#include "../action/Action.h"
+
+class PolicyCSV{
+
+	public:
+
+		static const size_t					MIN_RANGE_SIZE;
+
+		/**
+		 * What a column of the csv file holds, the ordinal of the action for values
+		 */
+		enum Column{
+			IGNORED		= -1,
+			POSITION_X	= -2,
+			POSITION_Y	= -3,
+			VELOCITY_X	= -4,
+			VELOCITY_Y	= -5
+		};
+
+		/**
+		 * Maps a csv file into memory and appends its states to a table. The columns are assigned by the header once,
+		 * actions missing in the file keep Action::DEFAULT_REWARD and unknown columns are ignored.
+		 * Importing stops at the first malformed line
+		 * @param	file				std::string				The file to import
+		 * @param	states				StateTable				The table to fill
+		 * @param	availableActions	std::vector<Action*>	The actions of the table
+		 * @param	bytes				size_t					Receives the size of the file
+		 * @return						long					The amount of lines imported, -1 if the file doesn't exist or has no valid header
+		 */
+		static long load(const std::string &file, StateTable &states, const std::vector<Action*> &availableActions, size_t &bytes);
+
+	private:
+
+		/**
+		 * The lines between two line boundaries and the states parsed from them
+		 */
+		struct Range{
+			const char				*begin;
+			const char				*end;
+
+			std::vector<State>		states;
+			std::vector<float>		values;		//states.size() rows of actionCount values
+
+			size_t					lines;		//the amount of lines parsed, including empty ones
+			bool					malformed;	//whether parsing stopped at a malformed line
+		};
+
+		/**
+		 * Parses the lines of a range, runs on its own thread
+		 * @param	range				Range					The range to parse
+		 * @param	columns				std::vector<int>		The Column or action ordinal of every column
+		 * @param	actionCount			int						The amount of values per state
+		 * @return						void
+		 */
+		static void parse(Range &range, const std::vector<int> &columns, int actionCount);
+};
+
+#endif /* AGENT_POLICYCSV_H_ */
@@ -0,0 +1,290 @@
+/*
+ * PolicyFile.cpp
+ *
+ * The binary policy format: a header carrying the action UIDs and the encoding of the values, followed by
+ * fixed-width records. It's read through mmap, loading it doesn't parse anything
+ */
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "PolicyFile.h"
+#include "StateTable.h"
+#include "State.h"
+#include "../action/Action.h"
+
+const char		PolicyFile::MAGIC[8]	= {'P', 'B', 'P', 'O', 'L', 'I', 'C', 'Y'};
+const uint32_t	PolicyFile::VERSION		= 2;
+
+bool PolicyFile::write(const std::string &file, const StateTable::Snapshot &snapshot, const std::vector<Action*> &availableActions, Encoding encoding, uint64_t generation){
+	std::string		temporary	= file + ".tmp";
+	std::ofstream	out(temporary, std::ios::binary | std::ios::trunc);
+
+	if(!out){
+		printf("ERROR: Couldn't open %s for writing!\n", temporary.c_str());
+		return false;
+	}
+
+	writeSegment(out, snapshot, snapshot.sortedIndices(), availableActions, encoding, generation);
+
+	out.close();
+
+	if(!out || std::rename(temporary.c_str(), file.c_str()) != 0){
+		printf("ERROR: Couldn't write %s!\n", file.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool PolicyFile::append(const std::string &file, const StateTable::Snapshot &snapshot, const std::vector<Action*> &availableActions, Encoding encoding, uint64_t generation){
+	std::ofstream out(file, std::ios::binary | std::ios::app);
+
+	if(!out){
+		printf("ERROR: Couldn't open %s for appending!\n", file.c_str());
+		return false;
+	}
+
+	writeSegment(out, snapshot, snapshot.getDirty(), availableActions, encoding, generation);
+
+	out.close();
+
+	if(!out){
+		printf("ERROR: Couldn't append to %s!\n", file.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void PolicyFile::writeSegment(std::ostream &out, const StateTable::Snapshot &snapshot, const std::vector<int> &indices,
+		const std::vector<Action*> &availableActions, Encoding encoding, uint64_t generation){
+
+	Header				header;
+	std::string			uids;
+	int					actionCount	= availableActions.size();
+	size_t				valueSize	= encoding == UINT16 ? sizeof(uint16_t) : sizeof(float);
+
+	for(int i=0;i<actionCount;i++){
+		uids.append(availableActions[i]->getUID());
+		uids.push_back('\0');
+	}
+
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version		= VERSION;
+	header.headerSize	= (sizeof(Header) + uids.size() + 7) / 8 * 8;
+	header.stateCount	= indices.size();
+	header.actionCount	= actionCount;
+	header.recordSize	= 4 * sizeof(int16_t) + actionCount * valueSize;
+	header.encoding		= encoding;
+	header.valueMin		= encoding == UINT16 ? Action::MIN_REWARD : 0.0f;
+	header.valueScale	= encoding == UINT16 ? (Action::MAX_REWARD - Action::MIN_REWARD) / 65535.0f : 1.0f;
+	header.uidBytes		= uids.size();
+	header.generation	= generation;
+
+	out.write((const char*) &header, sizeof(Header));
+	out.write(uids.data(), uids.size());
+	out.write("\0\0\0\0\0\0\0\0", header.headerSize - sizeof(Header) - uids.size());
+
+	//the records are written in blocks, one write per record would dominate
+	std::vector<char> block;
+
+	block.reserve(4096 * header.recordSize);
+
+	for(size_t k=0;k<indices.size();k++){
+		const State		&state		= snapshot[indices[k]];
+		const float		*values		= snapshot.getValues(indices[k]);
+		int16_t			key[4]		= {
+				(int16_t) state.ballPosition_x, (int16_t) state.ballPosition_y,
+				(int16_t) state.ballVelocity_x, (int16_t) state.ballVelocity_y
+		};
+
+		block.insert(block.end(), (const char*) key, (const char*) key + sizeof(key));
+
+		if(encoding == UINT16){
+			for(int j=0;j<actionCount;j++){
+				float		q		= std::round((values[j] - header.valueMin) / header.valueScale);
+				uint16_t	value	= (uint16_t) std::min(std::max(q, 0.0f), 65535.0f);
+
+				block.insert(block.end(), (const char*) &value, (const char*) &value + sizeof(value));
+			}
+		}else{
+			block.insert(block.end(), (const char*) values, (const char*) (values + actionCount));
+		}
+
+		if(block.size() + header.recordSize > block.capacity()){
+			out.write(block.data(), block.size());
+			block.clear();
+		}
+	}
+
+	out.write(block.data(), block.size());
+}
+
+const char* PolicyFile::map(const std::string &file, size_t &size){
+	int fd = open(file.c_str(), O_RDONLY);
+
+	if(fd == -1){
+		return NULL;
+	}
+
+	struct stat		info;
+	void			*mapped = MAP_FAILED;
+
+	if(fstat(fd, &info) == 0 && info.st_size > 0){
+		mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+
+	//the mapping stays valid without the descriptor
+	close(fd);
+
+	if(mapped == MAP_FAILED){
+		return NULL;
+	}
+
+	madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+
+	size = info.st_size;
+
+	return (const char*) mapped;
+}
+
+bool PolicyFile::readHeader(const char *data, size_t size, Header &header){
+	if(size < sizeof(Header)){
+		return false;
+	}
+
+	std::memcpy(&header, data, sizeof(Header));
+
+	size_t valueSize = header.encoding == UINT16 ? sizeof(uint16_t) : sizeof(float);
+
+	return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION
+			&& header.encoding <= UINT16 && header.recordSize == 4 * sizeof(int16_t) + header.actionCount * valueSize
+			&& header.headerSize >= sizeof(Header) + header.uidBytes
+			&& header.headerSize <= size && (size - header.headerSize) / header.recordSize >= header.stateCount;
+}
+
+void PolicyFile::applySegment(const char *data, const Header &header, StateTable &states, const std::vector<Action*> &availableActions){
+	size_t valueSize = header.encoding == UINT16 ? sizeof(uint16_t) : sizeof(float);
+
+	//resolve the UIDs once, actions[k] is the ordinal of the k-th value of a record or -1 if the action isn't available
+	std::vector<int>	actions(header.actionCount, -1);
+	const char			*uid	= data + sizeof(Header);
+	const char			*end	= uid + header.uidBytes;
+
+	for(uint32_t k=0;k<header.actionCount && uid < end;k++){
+		for(int j=0;j<availableActions.size();j++){
+			if(std::strcmp(uid, availableActions[j]->getUID()) == 0){
+				actions[k] = j;
+			}
+		}
+
+		uid += std::strlen(uid) + 1;
+	}
+
+	//every state is stored once per segment, so they don't have to be looked up if the table is empty
+	bool unique = states.size() == 0;
+
+	states.reserve(states.size() + header.stateCount);
+
+	const char *record = data + header.headerSize;
+
+	for(uint64_t i=0;i<header.stateCount;i++, record += header.recordSize){
+		int16_t key[4];
+
+		std::memcpy(key, record, sizeof(key));
+
+		State	state(key[0], key[1], key[2], key[3]);
+		float	*row = states.getValues(unique ? states.appendUnique(state) : states.findOrInsert(state));
+
+		for(uint32_t k=0;k<header.actionCount;k++){
+			if(actions[k] == -1){
+				continue;
+			}
+
+			const char *value = record + sizeof(key) + k * valueSize;
+
+			if(header.encoding == UINT16){
+				uint16_t q;
+				std::memcpy(&q, value, sizeof(q));
+				row[actions[k]] = header.valueMin + q * header.valueScale;
+			}else{
+				std::memcpy(&row[actions[k]], value, sizeof(float));
+			}
+		}
+	}
+}
+
+long PolicyFile::load(const std::string &file, StateTable &states, const std::vector<Action*> &availableActions, uint64_t &generation){
+	size_t		size	= 0;
+	const char	*data	= map(file, size);
+	Header		header;
+	long		loaded	= -1;
+
+	if(data == NULL){
+		return -1;
+	}
+
+	if(readHeader(data, size, header)){
+		applySegment(data, header, states, availableActions);
+
+		generation	= header.generation;
+		loaded		= header.stateCount;
+	}else{
+		printf("ERROR: %s isn't a valid policy file of version %u!\n", file.c_str(), VERSION);
+	}
+
+	munmap((void*) data, size);
+
+	return loaded;
+}
+
+long PolicyFile::replay(const std::string &file, StateTable &states, const std::vector<Action*> &availableActions, uint64_t generation){
+	size_t		size		= 0;
+	const char	*data		= map(file, size);
+	size_t		offset		= 0;
+	long		applied		= 0;
+	Header		header;
+
+	if(data == NULL){
+		return -1;
+	}
+
+	while(offset < size && readHeader(data + offset, size - offset, header)){
+		//a log that wasn't removed after compacting belongs to an older base, its values are outdated
+		if(header.generation == generation){
+			applySegment(data + offset, header, states, availableActions);
+			applied += header.stateCount;
+		}
+
+		offset += header.headerSize + header.stateCount * header.recordSize;
+	}
+
+	munmap((void*) data, size);
+
+	//the last checkpoint was cut off, drop it so the next one starts at a segment boundary
+	if(offset < size){
+		printf("WARNING: Dropping %lu bytes of an incomplete checkpoint at the end of %s\n", size - offset, file.c_str());
+
+		if(truncate(file.c_str(), offset) != 0){
+			printf("ERROR: Couldn't truncate %s!\n", file.c_str());
+		}
+	}
+
+	return applied;
+}
+
+std::string PolicyFile::getEncodingName(Encoding encoding){
+	return encoding == UINT16 ? "uint16" : "float32";
+}
@@ -0,0 +1,150 @@
+/*
+ * PolicyFile.h
+ *
+ * The binary policy format: a header carrying the action UIDs and the encoding of the values, followed by
+ * fixed-width records. It's read through mmap, loading it doesn't parse anything
+ *
+ * A full checkpoint (the base) is one such segment holding all states. Delta checkpoints only hold the states
+ * changed since the previous checkpoint and are appended to a separate log, one segment each. Every segment carries
+ * the generation of the base it belongs to, compacting the log into a new base increments it
+ *
+ * Layout of a segment (native byte order, little endian on x86):
+ *   Header					56 bytes, see below
+ *   action UIDs			Header::uidBytes bytes, actionCount null terminated strings in the order of the values
+ *   padding				up to Header::headerSize, a multiple of 8
+ *   records				stateCount * Header::recordSize bytes: int16 position x, position y, velocity x, velocity y,
+ *							then actionCount values, float32 or uint16 (value = valueMin + q * valueScale)
+ */
+
+#ifndef AGENT_POLICYFILE_H_
+#define AGENT_POLICYFILE_H_
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+
+#include "StateTable.h"
+#include "../action/Action.h"
+
+class PolicyFile{
+
+	public:
+
+		enum Encoding{
+			FLOAT32,	//lossless
+			UINT16		//quantized over [Action::MIN_REWARD, Action::MAX_REWARD], half the size
+		};
+
+		static const char					MAGIC[8];
+		static const uint32_t				VERSION;
+
+		struct Header{
+			char							magic[8];
+			uint32_t						version;
+			uint32_t						headerSize;
+			uint64_t						stateCount;
+			uint32_t						actionCount;
+			uint32_t						recordSize;
+			uint32_t						encoding;
+			float							valueMin;
+			float							valueScale;
+			uint32_t						uidBytes;
+			uint64_t						generation;
+		};
+
+		/**
+		 * Writes all states of a snapshot to a file. It's written to file + ".tmp" first and then renamed, so a reader never sees half a file
+		 * @param	file				std::string				The file to write
+		 * @param	snapshot			StateTable::Snapshot	The states and values to write
+		 * @param	availableActions	std::vector<Action*>	The actions the values belong to
+		 * @param	encoding			Encoding				How the values are stored
+		 * @param	generation			uint64_t				The generation of the new base
+		 * @return						bool					Whether the file was written
+		 */
+		static bool write(const std::string &file, const StateTable::Snapshot &snapshot, const std::vector<Action*> &availableActions, Encoding encoding, uint64_t generation);
+
+		/**
+		 * Appends the dirty states of a snapshot to a delta log as one segment
+		 * @param	file				std::string				The log to append to, created if it doesn't exist
+		 * @param	snapshot			StateTable::Snapshot	The snapshot, taken with takeDirty
+		 * @param	availableActions	std::vector<Action*>	The actions the values belong to
+		 * @param	encoding			Encoding				How the values are stored
+		 * @param	generation			uint64_t				The generation of the base the log belongs to
+		 * @return						bool					Whether the segment was written
+		 */
+		static bool append(const std::string &file, const StateTable::Snapshot &snapshot, const std::vector<Action*> &availableActions, Encoding encoding, uint64_t generation);
+
+		/**
+		 * Maps a base into memory and appends its states to a table. The values are assigned by the action UIDs,
+		 * actions missing in the file keep Action::DEFAULT_REWARD and unknown ones are ignored
+		 * @param	file				std::string				The file to load
+		 * @param	states				StateTable				The table to fill
+		 * @param	availableActions	std::vector<Action*>	The actions of the table
+		 * @param	generation			uint64_t				Receives the generation of the base
+		 * @return						long					The amount of states loaded, -1 if the file doesn't exist or isn't valid
+		 */
+		static long load(const std::string &file, StateTable &states, const std::vector<Action*> &availableActions, uint64_t &generation);
+
+		/**
+		 * Applies the segments of a delta log to a table in the order they were appended. Segments of other generations
+		 * are skipped, a segment cut off by a crash ends the log and is truncated, so the log can be appended to again
+		 * @param	file				std::string				The log to replay
+		 * @param	states				StateTable				The table holding the base
+		 * @param	availableActions	std::vector<Action*>	The actions of the table
+		 * @param	generation			uint64_t				The generation of the base
+		 * @return						long					The amount of records applied, -1 if there is no log
+		 */
+		static long replay(const std::string &file, StateTable &states, const std::vector<Action*> &availableActions, uint64_t generation);
+
+		/**
+		 * Returns the name of an encoding as used on the command line
+		 * @param	encoding			Encoding				The encoding to name
+		 * @return						std::string
+		 */
+		static std::string getEncodingName(Encoding encoding);
+
+		/**
+		 * Maps a whole file into memory, read-only
+		 * @param	file				std::string				The file to map
+		 * @param	size				size_t					Receives the size of the file
+		 * @return						char*					The mapping or NULL if the file doesn't exist or is empty, release it with munmap()
+		 */
+		static const char* map(const std::string &file, size_t &size);
+
+	private:
+
+		/**
+		 * Writes one segment
+		 * @param	out					std::ostream			The stream to write to
+		 * @param	snapshot			StateTable::Snapshot	The states and values to write
+		 * @param	indices				std::vector<int>		The indices of the states to write, in the order they're written
+		 * @param	availableActions	std::vector<Action*>	The actions the values belong to
+		 * @param	encoding			Encoding				How the values are stored
+		 * @param	generation			uint64_t				The generation of the base
+		 * @return						void
+		 */
+		static void writeSegment(std::ostream &out, const StateTable::Snapshot &snapshot, const std::vector<int> &indices,
+				const std::vector<Action*> &availableActions, Encoding encoding, uint64_t generation);
+
+		/**
+		 * Reads and validates the header of a segment
+		 * @param	data				char*					The start of the segment
+		 * @param	size				size_t					The amount of bytes left in the file
+		 * @param	header				Header					Receives the header
+		 * @return						bool					Whether the header is valid and the whole segment is available
+		 */
+		static bool readHeader(const char *data, size_t size, Header &header);
+
+		/**
+		 * Writes the records of a segment into a table, existing states are overwritten
+		 * @param	data				char*					The start of the segment
+		 * @param	header				Header					The validated header of the segment
+		 * @param	states				StateTable				The table to fill
+		 * @param	availableActions	std::vector<Action*>	The actions of the table
+		 * @return						void
+		 */
+		static void applySegment(const char *data, const Header &header, StateTable &states, const std::vector<Action*> &availableActions);
+};
+
+#endif /* AGENT_POLICYFILE_H_ */
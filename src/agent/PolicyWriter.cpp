@@ -0,0 +1,101 @@
+/*
+ * PolicyWriter.cpp
+ *
+ * Writes snapshots of the state table on a background thread, so saving the policies never stalls the simulation
+ */
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <utility>
+
+#include "PolicyWriter.h"
+#include "StateTable.h"
+
+PolicyWriter::PolicyWriter(std::function<void(const StateTable::Snapshot&)> write) :
+		write(write), hasPending(false), writing(false), stopping(false), lastWriteDuration(-1){
+}
+
+PolicyWriter::~PolicyWriter(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+
+	changed.notify_all();
+
+	//the loop only ends once nothing is pending anymore
+	if(thread.joinable()){
+		thread.join();
+	}
+}
+
+void PolicyWriter::submit(StateTable::Snapshot snapshot){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		//a delta checkpoint has to cover the changes of the dropped snapshot as well
+		if(hasPending){
+			snapshot.mergeDirty(pending);
+		}
+
+		pending		= std::move(snapshot);
+		hasPending	= true;
+
+		if(!thread.joinable()){
+			thread = std::thread(&PolicyWriter::run, this);
+		}
+	}
+
+	changed.notify_all();
+}
+
+void PolicyWriter::flush(){
+	std::unique_lock<std::mutex> guard(lock);
+
+	changed.wait(guard, [this]{
+		return !hasPending && !writing;
+	});
+}
+
+double PolicyWriter::getLastWriteDuration() const{
+	return lastWriteDuration.load();
+}
+
+void PolicyWriter::run(){
+	std::unique_lock<std::mutex> guard(lock);
+
+	while(true){
+		changed.wait(guard, [this]{
+			return hasPending || stopping;
+		});
+
+		if(!hasPending){
+			break;
+		}
+
+		StateTable::Snapshot snapshot = std::move(pending);
+
+		pending		= StateTable::Snapshot();
+		hasPending	= false;
+		writing		= true;
+
+		guard.unlock();
+
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+		write(snapshot);
+
+		lastWriteDuration.store(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+
+		//release the chunks before the next snapshot is taken, so the table doesn't have to copy them
+		snapshot = StateTable::Snapshot();
+
+		guard.lock();
+		writing = false;
+
+		changed.notify_all();
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * PolicyWriter.h
+ *
+ * Writes snapshots of the state table on a background thread, so saving the policies never stalls the simulation
+ */
+
+#ifndef AGENT_POLICYWRITER_H_
+#define AGENT_POLICYWRITER_H_
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "StateTable.h"
+
+class PolicyWriter{
+
+	private:
+
+		std::function<void(const StateTable::Snapshot&)>	write;
+
+		//started with the first snapshot submitted
+		std::thread											thread;
+
+		std::mutex											lock;
+		std::condition_variable								changed;
+
+		//the next snapshot to write, a newer one replaces it if it wasn't picked up yet and takes over its dirty states
+		StateTable::Snapshot								pending;
+		bool												hasPending;
+		bool												writing;
+		bool												stopping;
+
+		//in milliseconds, -1 if nothing was written yet
+		std::atomic<double>									lastWriteDuration;
+
+		/**
+		 * The loop of the writer thread
+		 * @return				void
+		 */
+		void run();
+
+	public:
+
+		/**
+		 * Inits the writer
+		 * @param	write		std::function<void(const StateTable::Snapshot&)>	Writes one snapshot, called on the writer thread
+		 */
+		PolicyWriter(std::function<void(const StateTable::Snapshot&)> write);
+
+		/**
+		 * Writes the pending snapshot and stops the writer thread
+		 */
+		~PolicyWriter();
+
+		/**
+		 * Hands a snapshot to the writer thread and returns immediately. If the previous one wasn't written yet,
+		 * it's dropped and its dirty states are merged into the new one
+		 * @param	snapshot	StateTable::Snapshot	The snapshot to write
+		 * @return				void
+		 */
+		void submit(StateTable::Snapshot snapshot);
+
+		/**
+		 * Waits until all submitted snapshots are written
+		 * @return				void
+		 */
+		void flush();
+
+		/**
+		 * Returns how long writing the last snapshot took
+		 * @return				double		The duration in milliseconds, -1 if nothing was written yet
+		 */
+		double getLastWriteDuration() const;
+};
+
+#endif /* AGENT_POLICYWRITER_H_ */
@@ -0,0 +1,115 @@
+/*
+ * RingBuffer.h
+ *
+ * A fixed-capacity FIFO that overwrites its oldest element once it's full, never allocates after construction
+ */
+
+#ifndef AGENT_RINGBUFFER_H_
+#define AGENT_RINGBUFFER_H_
+
+#include <vector>
+#include <cstddef>
+
+template<typename T>
+class RingBuffer{
+
+	private:
+
+		std::vector<T>		elements;
+
+		size_t				start;
+		size_t				count;
+
+		/**
+		 * Maps a position below twice the capacity into the buffer, without the division of a modulo
+		 * @param	i			size_t		The position, start + an offset below the capacity
+		 * @return				size_t
+		 */
+		size_t wrap(size_t i) const{
+			return i < elements.size() ? i : i - elements.size();
+		}
+
+	public:
+
+		/**
+		 * Inits the buffer
+		 * @param	capacity	size_t		The maximum amount of elements stored
+		 */
+		RingBuffer(size_t capacity = 0) : elements(capacity), start(0), count(0){
+		}
+
+		/**
+		 * Appends an element, drops the oldest one if the buffer is full
+		 * @param	element		T			The element to append
+		 * @return				void
+		 */
+		void push_back(const T &element){
+			if(elements.empty()){
+				return;
+			}
+
+			if(count < elements.size()){
+				elements[wrap(start + count)] = element;
+				count++;
+			}else{
+				elements[start] = element;
+				start = wrap(start + 1);
+			}
+		}
+
+		/**
+		 * Returns an element, 0 is the oldest one
+		 * @param	i			size_t		The position of the element
+		 * @return				T&
+		 */
+		T& operator[](size_t i){
+			return elements[wrap(start + i)];
+		}
+
+		const T& operator[](size_t i) const{
+			return elements[wrap(start + i)];
+		}
+
+		/**
+		 * Returns the newest element, the buffer mustn't be empty
+		 * @return				T&
+		 */
+		T& back(){
+			return (*this)[count - 1];
+		}
+
+		/**
+		 * Returns the amount of elements stored
+		 * @return				size_t
+		 */
+		size_t size() const{
+			return count;
+		}
+
+		/**
+		 * Returns the maximum amount of elements stored
+		 * @return				size_t
+		 */
+		size_t capacity() const{
+			return elements.size();
+		}
+
+		/**
+		 * Returns whether no element is stored
+		 * @return				bool
+		 */
+		bool empty() const{
+			return count == 0;
+		}
+
+		/**
+		 * Removes all elements, the capacity stays the same
+		 * @return				void
+		 */
+		void clear(){
+			start = 0;
+			count = 0;
+		}
+};
+
+#endif /* AGENT_RINGBUFFER_H_ */
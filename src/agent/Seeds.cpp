@@ -0,0 +1,29 @@
+/*
+ * Seeds.cpp
+ *
+ * Derives the seeds of all random number generators from one seed
+ */
+
+#include <chrono>
+#include <cstdint>
+
+#include "Seeds.h"
+
+uint64_t Seeds::fromClock(){
+	return (uint64_t) std::chrono::system_clock::now().time_since_epoch().count();
+}
+
+unsigned Seeds::derive(uint64_t seed, Stream stream, int worker){
+	//the golden ratio increments of SplitMix64 keep neighbouring streams and workers apart
+	uint64_t value = mix(mix(seed + (uint64_t) stream * 0x9E3779B97F4A7C15ull) + (uint64_t) worker * 0x9E3779B97F4A7C15ull);
+
+	return (unsigned) (value ^ (value >> 32));
+}
+
+uint64_t Seeds::mix(uint64_t value){
+	value += 0x9E3779B97F4A7C15ull;
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+
+	return value ^ (value >> 31);
+}
@@ -0,0 +1,52 @@
+/*
+ * Seeds.h
+ *
+ * Derives the seeds of all random number generators from one seed, so a run can be repeated exactly.
+ * Every component and every worker gets its own stream: adding a worker or drawing more numbers in one
+ * component doesn't shift the numbers of any other one
+ */
+
+#ifndef AGENT_SEEDS_H_
+#define AGENT_SEEDS_H_
+
+#include <cstdint>
+
+class Seeds{
+
+	public:
+
+		/**
+		 * The components drawing random numbers
+		 */
+		enum Stream{
+			AGENT	= 1,
+			KICKER	= 2,
+			PINS	= 3
+		};
+
+		/**
+		 * Generates a seed from the clock, for runs that don't have to be repeatable
+		 * @return				uint64_t
+		 */
+		static uint64_t fromClock();
+
+		/**
+		 * Derives the seed of one stream
+		 * @param	seed		uint64_t	The seed of the run
+		 * @param	stream		Stream		The component
+		 * @param	worker		int			The worker the component belongs to
+		 * @return				unsigned	The seed of the generator
+		 */
+		static unsigned derive(uint64_t seed, Stream stream, int worker);
+
+	private:
+
+		/**
+		 * One step of SplitMix64, a bijective mix of all 64 bits
+		 * @param	value		uint64_t
+		 * @return				uint64_t
+		 */
+		static uint64_t mix(uint64_t value);
+};
+
+#endif /* AGENT_SEEDS_H_ */
@@ -1,7 +1,7 @@
 /*
  * State.cpp
  *
- * Contains all the information of a state
+ * Contains all the information of a state, the values of its actions are stored in the StateTable
  */
 
 #include "State.h"
@@ -13,74 +13,52 @@
 
 #include <Box2D/Box2D.h>
 
-State::State(b2Vec2 ballPosition, b2Vec2 ballVelocity, std::vector<Action*> availableActions){
+const float State::MAX_ROUNDED_VALUE = 10.0f;
+
+State::State(b2Vec2 ballPosition, b2Vec2 ballVelocity){
 
 	ballPosition_x	= roundPos(ballPosition.x);
 	ballPosition_y	= roundPos(ballPosition.y);
 
 	ballVelocity_x	= roundVel(ballVelocity.x);
-	ballVelocity_x	= roundVel(ballVelocity.y);
-
-	for(int i=0;i<availableActions.size();i++){
-		setValue(availableActions[i], Action::DEFAULT_REWARD);
-	}
+	ballVelocity_y	= roundVel(ballVelocity.y);
 }
 
 State::State(int ballPosition_x, int ballPosition_y,
-				int ballVelocity_x, int ballVelocity_y,
-				std::vector<Action*> availableActions) :
+				int ballVelocity_x, int ballVelocity_y) :
 
 				ballPosition_x(ballPosition_x), ballPosition_y(ballPosition_y),
-				ballVelocity_x(ballVelocity_x), ballVelocity_y(ballPosition_y)
+				ballVelocity_x(ballVelocity_x), ballVelocity_y(ballVelocity_y)
 		{
-
-	for(int i=0;i<availableActions.size();i++){
-		setValue(availableActions[i], Action::DEFAULT_REWARD);
-	}
 }
 
-float State::getValue(Action *action){
-	return values[action];
-}
-
-float State::getGeneralValue(){
-	float max = 0;
-
-	for(auto const &iter : values){
-		if(iter.second > max){
-			max = iter.second;
-		}
-	}
-
-	return max;
-}
-
-void State::setValue(Action *action, float value){
-	values[action] = value;
+uint64_t State::getKey() const{
+	//every rounded component fits into 16 bits (see roundPos() and roundVel())
+	return ((uint64_t)(uint16_t) ballPosition_x << 48)
+			| ((uint64_t)(uint16_t) ballPosition_y << 32)
+			| ((uint64_t)(uint16_t) ballVelocity_x << 16)
+			| ((uint64_t)(uint16_t) ballVelocity_y);
 }
 
 int State::roundPos(float32 f){
-	if(f > 10){f = 0;}
+	if(f > MAX_ROUNDED_VALUE){f = 0;}
 	return (int) std::round(f * 100);
 }
 
 int State::roundVel(float32 f){
-	if(f > 10){f = 0;}
+	if(f > MAX_ROUNDED_VALUE){f = 0;}
 	return (int) std::round(f * 10);
 }
 
 void State::debug(){
-	printf("POS_x: %d, POS_y_ %d, VEL_x: %d, VEL_y: %d | ", ballPosition_x, ballPosition_y, ballVelocity_x, ballVelocity_y);
-	for(auto const &iter : values){
-		printf("%s : %f;", iter.first->getUID(), iter.second);
-	}
-	printf("\n");
+	printf("POS_x: %d, POS_y_ %d, VEL_x: %d, VEL_y: %d\n", ballPosition_x, ballPosition_y, ballVelocity_x, ballVelocity_y);
 }
 
 bool operator==(const State& lhs, const State& rhs){
 	return lhs.ballPosition_x == rhs.ballPosition_x
 			&& lhs.ballPosition_y == rhs.ballPosition_y
-			&& lhs.ballVelocity_x == rhs.ballVelocity_y;
+			&& lhs.ballVelocity_x == rhs.ballVelocity_x
+			&& lhs.ballVelocity_y == rhs.ballVelocity_y;
 }
 
 bool operator!=(const State& lhs, const State& rhs){
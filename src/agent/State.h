@@ -1,7 +1,7 @@
 /*
  * State.h
  *
- * Contains all the information of a state
+ * Contains all the information of a state, the values of its actions are stored in the StateTable
  */
 
 #ifndef AGENT_STATE_H_
@@ -11,17 +11,16 @@
 #include <vector>
 #include <cmath>
 #include <random>
-#include <map>
+#include <cstdint>
 
 #include <Box2D/Box2D.h>
 
-#include "../action/Action.h"
 
 class State{
 
 	public:
 
-		std::map<Action*, float> 		values;
+		static const float				MAX_ROUNDED_VALUE;
 
 		int								ballPosition_x;
 		int								ballPosition_y;
@@ -34,7 +33,7 @@ class State{
 		 * @param	ballPosition		b2Vec2					The ball position
 		 * @param	ballVelocity		b2Vec2					The ball velocity
 		 */
-		State(const b2Vec2 ballPosition = b2Vec2(0, 0), const b2Vec2 ballVelocity = b2Vec2(0, 0), std::vector<Action*> availableActions = std::vector<Action*>(0));
+		State(const b2Vec2 ballPosition = b2Vec2(0, 0), const b2Vec2 ballVelocity = b2Vec2(0, 0));
 
 		/**
 		 * Inits a state
@@ -43,45 +42,27 @@ class State{
 		 * @param	ballVelocity_x		int						The balls x velocity
 		 * @param	ballVelocity_y		int						The balls y velocity
 		 */
-		State(int ballPosition_x = 0, int ballPosition_y = 0, int ballVelocity_x = 0, int ballVelocity_y = 0, std::vector<Action*> availableActions = std::vector<Action*>(0));
+		State(int ballPosition_x = 0, int ballPosition_y = 0, int ballVelocity_x = 0, int ballVelocity_y = 0);
 
 		/**
-		 * Gets the expected reward if a specific action is taken
-		 * @param	action	*Action	The action of which the expected reward is returned
-		 * @return			float	The expected reward
+		 * Packs the rounded position and velocity into one key, equal states have equal keys
+		 * @return					uint64_t
 		 */
-
-		float getValue(Action *action);
-
-		/**
-		 * Gets the "general" value
-		 * @return			float	The expected reward
-		 */
-
-		float getGeneralValue();
-
-		/**
-		 * Sets the expected reward if a specific action is taken
-		 * @param	action	*Action	The action of which the expected reward is set
-		 * @param	value	float	The expected reward
-		 * @return			void
-		 */
-
-		void setValue(Action *action, float value);
+		uint64_t getKey() const;
 
 		/**
 		 * Rounds a float to a char (with "position precision")
 		 * @param	f				float32	The floating point number to round
 		 * @return					int
 		 */
-		int roundPos(float32 f);
+		static int roundPos(float32 f);
 
 		/**
 		 * Rounds a float to a char (with "velocity precision")
 		 * @param	f				float32	The floating point number to round
 		 * @return					int
 		 */
-		int roundVel(float32 f);
+		static int roundVel(float32 f);
 
 		/**
 		 * Prints some debugging values
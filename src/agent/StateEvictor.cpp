@@ -0,0 +1,143 @@
+/*
+ * StateEvictor.cpp
+ *
+ * Keeps a state table within a memory budget: a background thread watches the amount of states and once it
+ * exceeds HIGH_WATER of what fits into the budget, evicts cold states down to LOW_WATER
+ */
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+#include "StateEvictor.h"
+#include "StateTable.h"
+#include "../action/Action.h"
+
+const unsigned int	StateEvictor::POLL_INTERVAL		= 100; //ms
+const float			StateEvictor::HIGH_WATER		= 0.9f;
+const float			StateEvictor::LOW_WATER			= 0.8f;
+const int			StateEvictor::VISIT_BUCKETS		= 256;
+
+StateEvictor::StateEvictor(StateTable &states) :
+		states(states), stopping(false), maxMemory(0), evictedStates(0), lastSliceDuration(-1){
+}
+
+StateEvictor::~StateEvictor(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+
+	changed.notify_all();
+
+	if(thread.joinable()){
+		thread.join();
+	}
+}
+
+void StateEvictor::setMaxMemory(size_t bytes){
+	std::lock_guard<std::mutex> guard(lock);
+
+	maxMemory.store(bytes);
+
+	if(bytes != 0 && !thread.joinable()){
+		thread = std::thread(&StateEvictor::run, this);
+	}
+}
+
+unsigned long long StateEvictor::getEvictedStates() const{
+	return evictedStates.load();
+}
+
+double StateEvictor::getLastSliceDuration() const{
+	return lastSliceDuration.load();
+}
+
+void StateEvictor::run(){
+	std::unique_lock<std::mutex> guard(lock);
+
+	while(!stopping){
+		changed.wait_for(guard, std::chrono::milliseconds(POLL_INTERVAL), [this]{
+			return stopping;
+		});
+
+		if(stopping || maxMemory.load() == 0){
+			continue;
+		}
+
+		guard.unlock();
+
+		//the slots evicted by the last pass can be reused once all agents moved on, usually by now
+		states.reclaim();
+
+		size_t capacity = states.getStateCapacity(maxMemory.load());
+
+		if(states.size() > HIGH_WATER * capacity){
+			std::chrono::steady_clock::time_point	started		= std::chrono::steady_clock::now();
+			size_t									evicted		= evict(capacity);
+
+			printf("Evicted %lu states in %.1f ms (longest slice %.3f ms), %lu states left\n", evicted,
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count(),
+					lastSliceDuration.load(), states.size());
+		}
+
+		guard.lock();
+	}
+}
+
+size_t StateEvictor::evict(size_t capacity){
+	size_t	target		= LOW_WATER * capacity;
+	size_t	excess		= states.size() - std::min(states.size(), target);
+	size_t	indices		= states.getIndexCount();
+	size_t	evicted		= 0;
+	double	longest		= 0;
+
+	//the lowest visit count that still frees enough states if every state visited less often goes
+	std::vector<size_t>	histogram(VISIT_BUCKETS, 0);
+	uint32_t			threshold	= 0;
+	size_t				rare		= 0;
+
+	for(size_t i=0;i<indices;i++){
+		histogram[std::min(states.getVisits(i), (uint32_t) VISIT_BUCKETS - 1)]++;
+	}
+
+	while(threshold < VISIT_BUCKETS - 1 && rare + histogram[threshold] < excess){
+		rare += histogram[threshold++];
+	}
+
+	std::vector<float> row(states.getActionCount());
+
+	std::function<bool(int, uint32_t)> predicate = [&](int index, uint32_t visits){
+		if(visits <= threshold){
+			return true;
+		}
+
+		//states that never got a reward may go regardless of their visits, they'd be recreated the same way
+		states.copyValues(index, row.data());
+
+		return std::all_of(row.begin(), row.end(), [](float value){
+			return value == Action::DEFAULT_REWARD;
+		});
+	};
+
+	//the whole table is walked in any case, so the visits of every state kept are halved the same way
+	for(size_t begin=0;begin<indices;begin+=StateTable::CHUNK_SIZE){
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+		evicted += states.evict(begin, begin + StateTable::CHUNK_SIZE, predicate, excess - evicted);
+
+		longest = std::max(longest, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+	}
+
+	//starts the grace period of the evicted slots
+	states.reclaim();
+
+	evictedStates.fetch_add(evicted);
+	lastSliceDuration.store(longest);
+
+	return evicted;
+}
@@ -0,0 +1,95 @@
+/*
+ * StateEvictor.h
+ *
+ * Keeps a state table within a memory budget: a background thread watches the amount of states and once it
+ * exceeds HIGH_WATER of what fits into the budget, evicts cold states down to LOW_WATER. Cold states visited least often
+ * are evicted, as are ones whose values are all still Action::DEFAULT_REWARD, but never more than needed to get down
+ * to LOW_WATER. The table is walked in slices of StateTable::CHUNK_SIZE states and only one state is locked at a time,
+ * so the agents are never stalled by a pass
+ */
+
+#ifndef AGENT_STATEEVICTOR_H_
+#define AGENT_STATEEVICTOR_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "StateTable.h"
+
+class StateEvictor{
+
+	public:
+
+		static const unsigned int			POLL_INTERVAL;
+		static const float					HIGH_WATER;
+		static const float					LOW_WATER;
+		static const int					VISIT_BUCKETS;
+
+	private:
+
+		StateTable							&states;
+
+		//started once a budget is set
+		std::thread							thread;
+
+		std::mutex							lock;
+		std::condition_variable				changed;
+		bool								stopping;
+
+		//in bytes, 0 = unlimited
+		std::atomic<size_t>					maxMemory;
+
+		std::atomic<unsigned long long>		evictedStates;
+
+		//the longest slice of the last pass in milliseconds, -1 if nothing was evicted yet
+		std::atomic<double>					lastSliceDuration;
+
+		/**
+		 * The loop of the evictor thread
+		 * @return				void
+		 */
+		void run();
+
+		/**
+		 * Evicts states until at most LOW_WATER of the capacity is used
+		 * @param	capacity	size_t		The amount of states fitting into the budget
+		 * @return				size_t		The amount of states evicted
+		 */
+		size_t evict(size_t capacity);
+
+	public:
+
+		/**
+		 * Inits the evictor, nothing is evicted until a budget is set
+		 * @param	states		StateTable		The table to keep within the budget
+		 */
+		StateEvictor(StateTable &states);
+
+		/**
+		 * Stops the evictor thread
+		 */
+		~StateEvictor();
+
+		/**
+		 * Sets the budget and starts the evictor thread if needed
+		 * @param	bytes		size_t		The maximum amount of memory the table should use, 0 = unlimited
+		 * @return				void
+		 */
+		void setMaxMemory(size_t bytes);
+
+		/**
+		 * Returns the amount of states evicted so far
+		 * @return				unsigned long long
+		 */
+		unsigned long long getEvictedStates() const;
+
+		/**
+		 * Returns how long the longest slice of the last pass took, an upper bound of how long a lookup had to wait for it
+		 * @return				double		The duration in milliseconds, -1 if nothing was evicted yet
+		 */
+		double getLastSliceDuration() const;
+};
+
+#endif /* AGENT_STATEEVICTOR_H_ */
@@ -0,0 +1,864 @@
+/*
+ * StateTable.cpp
+ *
+ * Stores all the states the agent knows about. Indices never move once assigned
+ *
+ * The values are stored separately from the states: every state owns one contiguous row
+ * of getActionCount() floats, indexed by the ordinal of the action. States and rows live in fixed-size
+ * chunks which are never moved, so the table can grow while other threads read it
+ */
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <iterator>
+#include <climits>
+
+#include "StateTable.h"
+#include "KeyIndex.h"
+#include "State.h"
+#include "ValueKernels.h"
+#include "../action/Action.h"
+
+StateTable::Grid::Grid(int minPositionX, int maxPositionX, int minPositionY, int maxPositionY, int minVelocity, int maxVelocity) :
+		minPositionX(minPositionX), maxPositionX(maxPositionX),
+		minPositionY(minPositionY), maxPositionY(maxPositionY),
+		minVelocity(minVelocity), maxVelocity(maxVelocity){
+}
+
+size_t StateTable::Grid::getCellCount() const{
+	if(maxPositionX < minPositionX || maxPositionY < minPositionY || maxVelocity < minVelocity){
+		return 0;
+	}
+
+	size_t velocities = (size_t)(maxVelocity - minVelocity + 1);
+
+	return (size_t)(maxPositionX - minPositionX + 1) * (size_t)(maxPositionY - minPositionY + 1) * velocities * velocities;
+}
+
+bool StateTable::Grid::contains(const State &state) const{
+	return state.ballPosition_x >= minPositionX && state.ballPosition_x <= maxPositionX
+			&& state.ballPosition_y >= minPositionY && state.ballPosition_y <= maxPositionY
+			&& state.ballVelocity_x >= minVelocity && state.ballVelocity_x <= maxVelocity
+			&& state.ballVelocity_y >= minVelocity && state.ballVelocity_y <= maxVelocity;
+}
+
+size_t StateTable::Grid::getCellIndex(const State &state) const{
+	size_t velocities	= (size_t)(maxVelocity - minVelocity + 1);
+	size_t positionsY	= (size_t)(maxPositionY - minPositionY + 1);
+
+	return (((size_t)(state.ballPosition_x - minPositionX) * positionsY
+			+ (size_t)(state.ballPosition_y - minPositionY)) * velocities
+			+ (size_t)(state.ballVelocity_x - minVelocity)) * velocities
+			+ (size_t)(state.ballVelocity_y - minVelocity);
+}
+
+const int StateTable::CHUNK_SIZE	= 4096;
+const int StateTable::MAX_CHUNKS	= 4096; //≈16.7M states
+const int StateTable::SHARDS		= 64;
+const int StateTable::ROW_LOCKS		= 1024;
+const int StateTable::MAX_READERS	= 256;
+
+const State StateTable::EVICTED		= State(INT_MIN, INT_MIN, INT_MIN, INT_MIN);
+
+StateTable::StateTable(int actionCount, Type type, const Grid &grid) :
+		type(type), grid(grid), actionCount(actionCount), count(0),
+		chunks(MAX_CHUNKS), shards(SHARDS),
+		cells(type == DENSE ? grid.getCellCount() : 0), rowLocks(ROW_LOCKS), reindexed(false),
+		epoch(0), readers(MAX_READERS), evictedCount(0){
+
+	for(size_t i=0;i<cells.size();i++){
+		cells[i].store(-1, std::memory_order_relaxed);
+	}
+
+	for(int i=0;i<MAX_READERS;i++){
+		readers[i].active.store(false, std::memory_order_relaxed);
+		readers[i].published.store(0, std::memory_order_relaxed);
+	}
+}
+
+StateTable::Shard& StateTable::getShard(uint64_t key) const{
+	//bit n of a product only depends on the bits up to n of the key, so the high half is folded in before multiplying
+	uint64_t hash = (key ^ (key >> 32)) * 0x9E3779B97F4A7C15ULL;
+
+	return shards[(hash >> 32) % SHARDS];
+}
+
+std::mutex& StateTable::getRowLock(int index) const{
+	return rowLocks[index % ROW_LOCKS].lock;
+}
+
+int StateTable::find(const State &state) const{
+
+	if(type == DENSE && grid.contains(state)){
+		return cells[grid.getCellIndex(state)].load(std::memory_order_acquire);
+	}
+
+	uint64_t						key		= state.getKey();
+	Shard							&shard	= getShard(key);
+	std::lock_guard<std::mutex>		lock(shard.lock);
+
+	return shard.indices.find(key);
+}
+
+int StateTable::findOrInsert(const State &state){
+
+	if(type == DENSE && grid.contains(state)){
+		size_t				cellIndex	= grid.getCellIndex(state);
+		std::atomic<int>	&cell		= cells[cellIndex];
+		int					index		= cell.load(std::memory_order_acquire);
+
+		if(index != -1){
+			return index;
+		}
+
+		//the shard locks double as striped locks of the cells, so a cell is only filled once
+		std::lock_guard<std::mutex> lock(getShard(cellIndex).lock);
+
+		index = cell.load(std::memory_order_relaxed);
+
+		if(index == -1){
+			std::lock_guard<std::mutex> append(appendLock);
+
+			index = this->append(state);
+			cell.store(index, std::memory_order_release);
+		}
+
+		return index;
+	}
+
+	uint64_t						key		= state.getKey();
+	Shard							&shard	= getShard(key);
+	std::lock_guard<std::mutex>		lock(shard.lock);
+
+	int index = shard.indices.find(key);
+
+	if(index != -1){
+		return index;
+	}
+
+	{
+		std::lock_guard<std::mutex> append(appendLock);
+		index = this->append(state);
+	}
+
+	shard.indices.insert(key, index);
+
+	return index;
+}
+
+int StateTable::appendUnique(const State &state){
+	int index = this->append(state);
+
+	if(type == DENSE && grid.contains(state)){
+		cells[grid.getCellIndex(state)].store(index, std::memory_order_relaxed);
+	}else{
+		getShard(state.getKey()).indices.insert(state.getKey(), index);
+	}
+
+	return index;
+}
+
+int StateTable::append(const State &state){
+	if(!freeSlots.empty()){
+		int		index	= freeSlots.back();
+		Chunk	&chunk	= *chunks[index / CHUNK_SIZE];
+
+		freeSlots.pop_back();
+
+		//the slot is overwritten in place, a snapshot may still read the evicted state and the old row
+		unshareStates(chunk);
+
+		if(chunk.shared){
+			unshare(chunk);
+		}
+
+		(*chunk.states)[index % CHUNK_SIZE] = state;
+		std::fill_n(getValues(index), actionCount, Action::DEFAULT_REWARD);
+		chunk.visits[index % CHUNK_SIZE].store(0, std::memory_order_relaxed);
+		chunk.lastVisits[index % CHUNK_SIZE].store(epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		markDirty(index);
+
+		evictedCount.fetch_sub(1, std::memory_order_release);
+
+		return index;
+	}
+
+	size_t index = count.load(std::memory_order_relaxed);
+
+	if(index >= (size_t) MAX_CHUNKS * CHUNK_SIZE){
+		throw std::length_error("The state table is full");
+	}
+
+	allocateChunk(index / CHUNK_SIZE);
+
+	//a snapshot only reads the states and rows it counted, so a shared chunk can be appended to
+	chunks[index / CHUNK_SIZE]->states->push_back(state);
+	std::fill_n(getValues(index), actionCount, Action::DEFAULT_REWARD);
+	chunks[index / CHUNK_SIZE]->visits[index % CHUNK_SIZE].store(0, std::memory_order_relaxed);
+	chunks[index / CHUNK_SIZE]->lastVisits[index % CHUNK_SIZE].store(epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	markDirty(index);
+
+	//publish the state only once it's completely written
+	count.store(index + 1, std::memory_order_release);
+
+	return (int) index;
+}
+
+void StateTable::allocateChunk(int chunk){
+	if(!chunks[chunk]){
+		chunks[chunk].reset(new Chunk());
+		chunks[chunk]->states.reset(new std::vector<State>());
+		chunks[chunk]->states->reserve(CHUNK_SIZE);
+		chunks[chunk]->values.reset(new std::vector<float>((size_t) CHUNK_SIZE * actionCount));
+		chunks[chunk]->shared = false;
+		chunks[chunk]->statesShared = false;
+		chunks[chunk]->dirty = std::vector<std::atomic<uint64_t>>((CHUNK_SIZE + 63) / 64);
+		chunks[chunk]->visits = std::vector<std::atomic<uint32_t>>(CHUNK_SIZE);
+		chunks[chunk]->lastVisits = std::vector<std::atomic<uint32_t>>(CHUNK_SIZE);
+
+		for(size_t i=0;i<chunks[chunk]->dirty.size();i++){
+			chunks[chunk]->dirty[i].store(0, std::memory_order_relaxed);
+		}
+
+		for(int i=0;i<CHUNK_SIZE;i++){
+			chunks[chunk]->visits[i].store(0, std::memory_order_relaxed);
+			chunks[chunk]->lastVisits[i].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+void StateTable::markDirty(int index){
+	std::atomic<uint64_t>	&word	= chunks[index / CHUNK_SIZE]->dirty[(index % CHUNK_SIZE) / 64];
+	uint64_t				bit		= 1ULL << (index % 64);
+
+	//most writes hit states that are dirty already, checking first keeps the word from bouncing between threads
+	if((word.load(std::memory_order_relaxed) & bit) == 0){
+		word.fetch_or(bit, std::memory_order_relaxed);
+	}
+}
+
+void StateTable::collectDirty(std::vector<int> *dirty){
+	for(int c=0;c<MAX_CHUNKS && chunks[c];c++){
+		for(size_t i=0;i<chunks[c]->dirty.size();i++){
+			uint64_t bits = chunks[c]->dirty[i].load(std::memory_order_relaxed);
+
+			if(bits == 0){
+				continue;
+			}
+
+			chunks[c]->dirty[i].store(0, std::memory_order_relaxed);
+
+			while(dirty != NULL && bits != 0){
+				int index = c * CHUNK_SIZE + i * 64 + __builtin_ctzll(bits);
+
+				if(!isEvicted((*this)[index])){
+					dirty->push_back(index);
+				}
+
+				bits &= bits - 1;
+			}
+		}
+	}
+}
+
+State& StateTable::operator[](int index){
+	return (*chunks[index / CHUNK_SIZE]->states)[index % CHUNK_SIZE];
+}
+
+const State& StateTable::operator[](int index) const{
+	return (*chunks[index / CHUNK_SIZE]->states)[index % CHUNK_SIZE];
+}
+
+float* StateTable::getValues(int index){
+	return chunks[index / CHUNK_SIZE]->values->data() + (size_t)(index % CHUNK_SIZE) * actionCount;
+}
+
+const float* StateTable::getValues(int index) const{
+	return chunks[index / CHUNK_SIZE]->values->data() + (size_t)(index % CHUNK_SIZE) * actionCount;
+}
+
+void StateTable::lockRows(){
+	for(int i=0;i<ROW_LOCKS;i++){
+		rowLocks[i].lock.lock();
+	}
+}
+
+void StateTable::unlockRows(){
+	for(int i=ROW_LOCKS-1;i>=0;i--){
+		rowLocks[i].lock.unlock();
+	}
+}
+
+void StateTable::unshare(Chunk &chunk){
+	//appendLock is held like in snapshot(), as append() writes new rows without a row lock
+	lockRows();
+
+	//nothing has to be copied if the snapshots holding the chunk are gone already
+	if(chunk.shared && chunk.values.use_count() > 1){
+		chunk.values.reset(new std::vector<float>(*chunk.values));
+	}
+
+	//use_count() is a relaxed load: the fence orders the reads of the last snapshot released before the writes to come
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	chunk.shared = false;
+
+	unlockRows();
+}
+
+void StateTable::unshareStates(Chunk &chunk){
+	if(chunk.statesShared && chunk.states.use_count() > 1){
+		std::shared_ptr<std::vector<State>> copy(new std::vector<State>());
+
+		copy->reserve(CHUNK_SIZE);
+		copy->insert(copy->end(), chunk.states->begin(), chunk.states->end());
+
+		chunk.states = copy;
+	}
+
+	//see unshare()
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	chunk.statesShared = false;
+}
+
+float* StateTable::lockValuesForWrite(int index, std::unique_lock<std::mutex> &lock){
+	Chunk &chunk = *chunks[index / CHUNK_SIZE];
+
+	lock = std::unique_lock<std::mutex>(getRowLock(index));
+
+	//another snapshot may be taken while the row is unlocked
+	while(chunk.shared){
+		lock.unlock();
+
+		{
+			std::lock_guard<std::mutex> append(appendLock);
+			unshare(chunk);
+		}
+
+		lock.lock();
+	}
+
+	return getValues(index);
+}
+
+void StateTable::copyValues(int index, float *values) const{
+	std::lock_guard<std::mutex> lock(getRowLock(index));
+
+	std::copy_n(getValues(index), actionCount, values);
+}
+
+float StateTable::getValue(int index, int action) const{
+	std::lock_guard<std::mutex> lock(getRowLock(index));
+
+	return getValues(index)[action];
+}
+
+void StateTable::setValue(int index, int action, float value){
+	std::unique_lock<std::mutex> lock;
+
+	lockValuesForWrite(index, lock)[action] = value;
+	markDirty(index);
+}
+
+void StateTable::updateValues(int index, const float *scales, const float *offsets){
+	std::unique_lock<std::mutex> lock;
+
+	ValueKernels::affine(lockValuesForWrite(index, lock), scales, offsets, actionCount);
+	markDirty(index);
+}
+
+void StateTable::updateValues(int index, const int *actions, const float *scales, const float *offsets, int count){
+	std::unique_lock<std::mutex>	lock;
+	float							*values	= lockValuesForWrite(index, lock);
+
+	for(int i=0;i<count;i++){
+		values[actions[i]] = scales[i] * values[actions[i]] + offsets[i];
+	}
+
+	markDirty(index);
+}
+
+float StateTable::getGeneralValue(int index) const{
+	std::lock_guard<std::mutex>		lock(getRowLock(index));
+	const float						*row	= getValues(index);
+	float							max		= 0;
+
+	for(int i=0;i<actionCount;i++){
+		if(row[i] > max){
+			max = row[i];
+		}
+	}
+
+	return max;
+}
+
+int StateTable::getActionCount() const{
+	return actionCount;
+}
+
+size_t StateTable::size() const{
+	return count.load(std::memory_order_acquire) - evictedCount.load(std::memory_order_acquire);
+}
+
+size_t StateTable::getIndexCount() const{
+	return count.load(std::memory_order_acquire);
+}
+
+bool StateTable::isEvicted(const State &state){
+	return state.ballPosition_x == EVICTED.ballPosition_x;
+}
+
+void StateTable::visit(int index){
+	Chunk					&chunk		= *chunks[index / CHUNK_SIZE];
+	std::atomic<uint32_t>	&visits		= chunk.visits[index % CHUNK_SIZE];
+	std::atomic<uint32_t>	&lastVisit	= chunk.lastVisits[index % CHUNK_SIZE];
+	uint32_t				now			= epoch.load(std::memory_order_relaxed);
+	uint32_t				last		= lastVisit.load(std::memory_order_relaxed);
+
+	//never moves back, a thread that read the epoch earlier mustn't make the state look colder than it is
+	while(last < now && !lastVisit.compare_exchange_weak(last, now, std::memory_order_relaxed)){
+	}
+
+	//concurrent visits may be counted once, it's only a heuristic
+	visits.store(visits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+uint32_t StateTable::getVisits(int index) const{
+	return chunks[index / CHUNK_SIZE]->visits[index % CHUNK_SIZE].load(std::memory_order_relaxed);
+}
+
+int StateTable::registerReader(){
+	for(int i=0;i<MAX_READERS;i++){
+		bool expected = false;
+
+		if(readers[i].active.compare_exchange_strong(expected, true)){
+			//a new reader doesn't hold any index yet
+			readers[i].observed		= epoch.load();
+			readers[i].decisions	= 0;
+			readers[i].published.store(readers[i].observed, std::memory_order_release);
+
+			return i;
+		}
+	}
+
+	throw std::length_error("Too many readers of the state table");
+}
+
+void StateTable::unregisterReader(int reader){
+	readers[reader].active.store(false, std::memory_order_release);
+}
+
+void StateTable::quiesce(int reader, size_t heldDecisions){
+	Reader		&self		= readers[reader];
+	uint32_t	current		= epoch.load(std::memory_order_acquire);
+
+	if(current != self.observed){
+		self.observed	= current;
+		self.decisions	= 0;
+	}
+
+	//heldDecisions decisions after seeing the epoch, every index held was got in that epoch or later
+	if(self.decisions < heldDecisions){
+		self.decisions++;
+	}else if(self.published.load(std::memory_order_relaxed) != self.observed){
+		self.published.store(self.observed, std::memory_order_release);
+	}
+}
+
+uint32_t StateTable::getSafeEpoch() const{
+	uint32_t safe = epoch.load(std::memory_order_acquire);
+
+	for(int i=0;i<MAX_READERS;i++){
+		if(readers[i].active.load(std::memory_order_acquire)){
+			safe = std::min(safe, readers[i].published.load(std::memory_order_acquire));
+		}
+	}
+
+	return safe;
+}
+
+size_t StateTable::evict(int begin, int end, const std::function<bool(int, uint32_t)> &predicate, size_t limit){
+	uint32_t			safeEpoch	= getSafeEpoch();
+	size_t				evicted		= 0;
+	std::vector<State>	candidates;
+
+	//copy the states first, the locks of a state have to be taken in the order findOrInsert() takes them
+	{
+		std::lock_guard<std::mutex> append(appendLock);
+
+		end = std::min((size_t) end, count.load());
+
+		for(int i=begin;i<end;i++){
+			candidates.push_back((*this)[i]);
+		}
+	}
+
+	for(int i=begin;i<end;i++){
+		const State				&state		= candidates[i - begin];
+		Chunk					&chunk		= *chunks[i / CHUNK_SIZE];
+		std::atomic<uint32_t>	&visits		= chunk.visits[i % CHUNK_SIZE];
+
+		if(isEvicted(state)){
+			continue;
+		}
+
+		//visited since a reader passed the safe epoch: it may be in a trace
+		bool cold = chunk.lastVisits[i % CHUNK_SIZE].load(std::memory_order_relaxed) < safeEpoch;
+
+		//only states actually evicted count towards the limit, evictState() may still refuse one
+		if(evicted < limit && cold && predicate(i, visits.load(std::memory_order_relaxed)) && evictState(i, state, safeEpoch)){
+			evicted++;
+		}else{
+			visits.store(visits.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+		}
+	}
+
+	return evicted;
+}
+
+bool StateTable::evictState(int index, const State &state, uint32_t safeEpoch){
+	bool							dense		= type == DENSE && grid.contains(state);
+	size_t							cellIndex	= dense ? grid.getCellIndex(state) : 0;
+	uint64_t						key			= state.getKey();
+	Shard							&shard		= getShard(dense ? cellIndex : key);
+	std::lock_guard<std::mutex>		lock(shard.lock);
+	std::lock_guard<std::mutex>		append(appendLock);
+	Chunk							&chunk		= *chunks[index / CHUNK_SIZE];
+
+	//check again now that it can't be found anymore meanwhile
+	if((*this)[index] != state || chunk.lastVisits[index % CHUNK_SIZE].load(std::memory_order_relaxed) >= safeEpoch){
+		return false;
+	}
+
+	if(dense){
+		cells[cellIndex].store(-1, std::memory_order_release);
+	}else{
+		shard.indices.erase(key);
+	}
+
+	unshareStates(chunk);
+
+	(*chunk.states)[index % CHUNK_SIZE] = EVICTED;
+
+	retiredSlots.push_back(std::make_pair(index, epoch.load(std::memory_order_relaxed)));
+	evictedCount.fetch_add(1, std::memory_order_release);
+
+	return true;
+}
+
+size_t StateTable::reclaim(){
+	uint32_t						safeEpoch	= getSafeEpoch();
+	size_t							freed		= 0;
+	std::lock_guard<std::mutex>		append(appendLock);
+
+	for(size_t i=0;i<retiredSlots.size();i++){
+		if(retiredSlots[i].second < safeEpoch){
+			freeSlots.push_back(retiredSlots[i].first);
+			freed++;
+		}else{
+			retiredSlots[i - freed] = retiredSlots[i];
+		}
+	}
+
+	retiredSlots.resize(retiredSlots.size() - freed);
+
+	//the readers have to see a new epoch before the slots evicted from now on can be freed
+	epoch.fetch_add(1, std::memory_order_acq_rel);
+
+	return freed;
+}
+
+size_t StateTable::getStateCapacity(size_t bytes) const{
+	size_t fixed		= chunks.capacity() * sizeof(std::unique_ptr<Chunk>)
+							+ cells.capacity() * sizeof(std::atomic<int>)
+							+ shards.capacity() * sizeof(Shard)
+							+ rowLocks.capacity() * sizeof(RowLock)
+							+ readers.capacity() * sizeof(Reader);
+
+	//the hash index is kept at most half full
+	size_t perState		= sizeof(State) + actionCount * sizeof(float) + 2 * sizeof(std::atomic<uint32_t>) + 1
+							+ (type == SPARSE ? 2 * (sizeof(uint64_t) + sizeof(int)) : 0);
+
+	return bytes > fixed ? (bytes - fixed) / perState : 0;
+}
+
+void StateTable::reserve(size_t amount){
+	amount = std::min(amount, (size_t) MAX_CHUNKS * CHUNK_SIZE);
+
+	for(size_t c=0;c * CHUNK_SIZE < amount;c++){
+		allocateChunk(c);
+	}
+
+	if(type == SPARSE){
+		for(int i=0;i<SHARDS;i++){
+			shards[i].indices.reserve(amount / SHARDS + 1);
+		}
+	}
+}
+
+void StateTable::clear(){
+	//the chunks stay allocated, like the capacity of a vector, unless a snapshot still holds them
+	for(int c=0;c<MAX_CHUNKS && chunks[c];c++){
+		if(chunks[c]->shared || chunks[c]->statesShared){
+			chunks[c].reset();
+			allocateChunk(c);
+		}else{
+			chunks[c]->states->clear();
+		}
+	}
+
+	count.store(0);
+
+	retiredSlots.clear();
+	freeSlots.clear();
+	evictedCount.store(0);
+
+	for(int i=0;i<SHARDS;i++){
+		shards[i].indices.clear();
+	}
+
+	for(size_t i=0;i<cells.size();i++){
+		cells[i].store(-1, std::memory_order_relaxed);
+	}
+
+	collectDirty(NULL);
+	reindexed = true;
+}
+
+size_t StateTable::removeIf(std::function<bool(int)> predicate){
+	size_t previousSize = size();
+	size_t previousCount = count.load();
+	size_t kept = 0;
+
+	//the states are moved in place, so snapshots mustn't see them anymore
+	for(int c=0;c<MAX_CHUNKS && chunks[c];c++){
+		if(chunks[c]->shared || chunks[c]->statesShared){
+			chunks[c]->states.reset(new std::vector<State>(*chunks[c]->states));
+			chunks[c]->states->reserve(CHUNK_SIZE);
+			chunks[c]->values.reset(new std::vector<float>(*chunks[c]->values));
+			chunks[c]->shared = false;
+			chunks[c]->statesShared = false;
+		}
+	}
+
+	//move every state that is kept (and its row) to the front, the predicate only ever sees untouched states
+	for(size_t i=0;i<previousCount;i++){
+		if(isEvicted((*this)[i]) || predicate((int) i)){
+			continue;
+		}
+
+		if(kept != i){
+			(*this)[kept] = (*this)[i];
+			std::copy_n(getValues(i), actionCount, getValues(kept));
+			chunks[kept / CHUNK_SIZE]->visits[kept % CHUNK_SIZE].store(getVisits(i), std::memory_order_relaxed);
+			chunks[kept / CHUNK_SIZE]->lastVisits[kept % CHUNK_SIZE].store(
+					chunks[i / CHUNK_SIZE]->lastVisits[i % CHUNK_SIZE].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+
+		kept++;
+	}
+
+	//drop the states behind the last one kept, the rows are overwritten once a state is appended again
+	for(size_t c=0;c<MAX_CHUNKS && chunks[c];c++){
+		std::vector<State>	&states		= *chunks[c]->states;
+		size_t				inChunk		= kept > c * CHUNK_SIZE ? std::min(kept - c * CHUNK_SIZE, (size_t) CHUNK_SIZE) : 0;
+
+		states.erase(states.begin() + inChunk, states.end());
+	}
+
+	count.store(kept);
+
+	//the evicted slots were dropped as well
+	retiredSlots.clear();
+	freeSlots.clear();
+	evictedCount.store(0);
+
+	//the remaining states moved, so the indices have to be rebuilt
+	reindex();
+
+	//the dirty bits refer to the old indices, a checkpoint has to store everything now
+	collectDirty(NULL);
+	reindexed = true;
+
+	return previousSize - kept;
+}
+
+void StateTable::reindex(){
+	for(int i=0;i<SHARDS;i++){
+		shards[i].indices.clear();
+	}
+
+	for(size_t i=0;i<cells.size();i++){
+		cells[i].store(-1, std::memory_order_relaxed);
+	}
+
+	for(int i=0;i<count.load();i++){
+		const State &state = (*this)[i];
+
+		if(type == DENSE && grid.contains(state)){
+			cells[grid.getCellIndex(state)].store(i, std::memory_order_relaxed);
+		}else{
+			getShard(state.getKey()).indices.insert(state.getKey(), i);
+		}
+	}
+}
+
+StateTable::Snapshot StateTable::snapshot(bool takeDirty){
+	Snapshot						snapshot;
+
+	//no state is appended and no row written while the chunks are collected
+	std::lock_guard<std::mutex>		append(appendLock);
+
+	size_t							chunkCount	= (count.load() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	snapshot.count			= count.load();
+	snapshot.actionCount	= actionCount;
+	snapshot.states.reserve(chunkCount);
+	snapshot.values.reserve(chunkCount);
+
+	lockRows();
+
+	for(size_t c=0;c<chunkCount;c++){
+		snapshot.states.push_back(chunks[c]->states);
+		snapshot.values.push_back(chunks[c]->values);
+
+		chunks[c]->shared = true;
+		chunks[c]->statesShared = true;
+	}
+
+	//every write marks its state while holding the row lock, so each change is either in this snapshot or dirty again afterwards
+	if(takeDirty){
+		collectDirty(&snapshot.dirty);
+
+		snapshot.reindexed	= reindexed;
+		reindexed			= false;
+	}
+
+	unlockRows();
+
+	return snapshot;
+}
+
+void StateTable::clearDirty(){
+	std::lock_guard<std::mutex> append(appendLock);
+
+	lockRows();
+
+	collectDirty(NULL);
+	reindexed = false;
+
+	unlockRows();
+}
+
+std::vector<int> StateTable::sortedIndices() const{
+	std::vector<int> sorted;
+
+	for(int i=0;i<count.load();i++){
+		if(!isEvicted((*this)[i])){
+			sorted.push_back(i);
+		}
+	}
+
+	std::sort(sorted.begin(), sorted.end(), [this](int a, int b){
+		return (*this)[a] < (*this)[b];
+	});
+
+	return sorted;
+}
+
+StateTable::Type StateTable::getType() const{
+	return type;
+}
+
+std::string StateTable::getTypeName(Type type){
+	return type == DENSE ? "dense" : "sparse";
+}
+
+size_t StateTable::getMemoryUsage() const{
+	size_t usage		= chunks.capacity() * sizeof(std::unique_ptr<Chunk>)
+							+ cells.capacity() * sizeof(std::atomic<int>)
+							+ shards.capacity() * sizeof(Shard)
+							+ rowLocks.capacity() * sizeof(RowLock)
+							+ readers.capacity() * sizeof(Reader);
+
+	for(int c=0;c<MAX_CHUNKS && chunks[c];c++){
+		usage += sizeof(Chunk) + chunks[c]->states->capacity() * sizeof(State) + chunks[c]->values->capacity() * sizeof(float)
+					+ chunks[c]->dirty.capacity() * sizeof(std::atomic<uint64_t>)
+					+ (chunks[c]->visits.capacity() + chunks[c]->lastVisits.capacity()) * sizeof(std::atomic<uint32_t>);
+	}
+
+	for(int i=0;i<SHARDS;i++){
+		std::lock_guard<std::mutex> lock(shards[i].lock);
+
+		usage += shards[i].indices.getMemoryUsage();
+	}
+
+	return usage;
+}
+
+StateTable::Snapshot::Snapshot() : count(0), actionCount(0), reindexed(false){
+}
+
+size_t StateTable::Snapshot::size() const{
+	return count;
+}
+
+int StateTable::Snapshot::getActionCount() const{
+	return actionCount;
+}
+
+const State& StateTable::Snapshot::operator[](int index) const{
+	return (*states[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+}
+
+const float* StateTable::Snapshot::getValues(int index) const{
+	return values[index / CHUNK_SIZE]->data() + (size_t)(index % CHUNK_SIZE) * actionCount;
+}
+
+std::vector<int> StateTable::Snapshot::sortedIndices() const{
+	std::vector<int> sorted;
+
+	for(int i=0;i<count;i++){
+		if(!isEvicted((*this)[i])){
+			sorted.push_back(i);
+		}
+	}
+
+	std::sort(sorted.begin(), sorted.end(), [this](int a, int b){
+		return (*this)[a] < (*this)[b];
+	});
+
+	return sorted;
+}
+
+const std::vector<int>& StateTable::Snapshot::getDirty() const{
+	return dirty;
+}
+
+bool StateTable::Snapshot::isReindexed() const{
+	return reindexed;
+}
+
+void StateTable::Snapshot::mergeDirty(const Snapshot &older){
+	reindexed = reindexed || older.reindexed;
+
+	//the indices of the older snapshot may not be valid anymore, and a complete copy is needed anyway
+	if(reindexed){
+		dirty.clear();
+		return;
+	}
+
+	std::vector<int> merged;
+
+	merged.reserve(dirty.size() + older.dirty.size());
+	std::set_union(dirty.begin(), dirty.end(), older.dirty.begin(), older.dirty.end(), std::back_inserter(merged));
+
+	dirty.swap(merged);
+}
@@ -0,0 +1,615 @@
+/*
+ * StateTable.h
+ *
+ * Stores all the states the agent knows about. Indices never move once assigned
+ *
+ * The values are stored separately from the states: every state owns one contiguous row
+ * of getActionCount() floats, indexed by the ordinal of the action. States and rows live in fixed-size
+ * chunks which are never moved, so the table can grow while other threads read it
+ *
+ * Lookups, inserts and the value accessors may be called from multiple threads at once: the hash index is split
+ * into shards with one lock each, the dense index is read lock-free and every row is guarded by one of ROW_LOCKS striped locks.
+ * reserve(), clear() and removeIf() are not synchronized, no other thread may use the table meanwhile
+ *
+ * snapshot() freezes the table without copying it: the snapshot shares the chunks and a chunk is copied
+ * before it's written the next time (copy-on-write), so taking one only takes a few microseconds
+ *
+ * Every state appended or written is marked dirty, snapshot(true) hands out the dirty states and unmarks them,
+ * so a checkpoint only has to store what changed since the last one
+ *
+ * States can be evicted while the table is used: an evicted state is removed from the index and its slot is left
+ * behind as a tombstone, so no other index moves. A slot is only reused once every registered reader passed
+ * a quiescent point (see quiesce()) after the eviction, so an index still held by a trace is never reassigned
+ */
+
+#ifndef AGENT_STATETABLE_H_
+#define AGENT_STATETABLE_H_
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "State.h"
+#include "KeyIndex.h"
+#include "../action/Action.h"
+
+class StateTable{
+
+	public:
+
+		enum Type{
+			SPARSE,	//hash index, memory grows with the amount of states visited
+			DENSE	//preallocated flat index over a grid, falls back to the hash index outside of it
+		};
+
+		/**
+		 * A bounded grid of rounded state components, used to address the dense index directly
+		 */
+		class Grid{
+
+			public:
+
+				int		minPositionX, maxPositionX;
+				int		minPositionY, maxPositionY;
+				int		minVelocity, maxVelocity;
+
+				/**
+				 * Inits a grid, all bounds are inclusive and in rounded units (see State::roundPos() and State::roundVel())
+				 */
+				Grid(int minPositionX = 0, int maxPositionX = -1, int minPositionY = 0, int maxPositionY = -1, int minVelocity = 0, int maxVelocity = 0);
+
+				/**
+				 * Returns the amount of cells inside the grid
+				 * @return				size_t
+				 */
+				size_t getCellCount() const;
+
+				/**
+				 * Returns whether a state lies inside of the grid
+				 * @param	state		State		The state to check
+				 * @return				bool
+				 */
+				bool contains(const State &state) const;
+
+				/**
+				 * Returns the position of the state inside of the flat index, the state has to be inside of the grid
+				 * @param	state		State		The state to address
+				 * @return				size_t
+				 */
+				size_t getCellIndex(const State &state) const;
+		};
+
+		static const int						CHUNK_SIZE;
+		static const int						MAX_CHUNKS;
+		static const int						SHARDS;
+		static const int						ROW_LOCKS;
+		static const int						MAX_READERS;
+
+		/**
+		 * A frozen copy of the table, it can be read by any thread while the table keeps changing
+		 */
+		class Snapshot{
+
+			friend class StateTable;
+
+			private:
+
+				size_t												count;
+				int													actionCount;
+
+				//the buffers of the chunks at the time the snapshot was taken
+				std::vector<std::shared_ptr<const std::vector<State>>>	states;
+				std::vector<std::shared_ptr<const std::vector<float>>>	values;
+
+				//the states changed since the previous snapshot taken with takeDirty and not evicted, ascending
+				std::vector<int>									dirty;
+
+				//whether indices were reassigned since then, dirty doesn't cover all changes in that case
+				bool												reindexed;
+
+			public:
+
+				/**
+				 * Inits an empty snapshot
+				 */
+				Snapshot();
+
+				/**
+				 * Returns the amount of indices in the snapshot, evicted slots included (see StateTable::isEvicted())
+				 * @return				size_t
+				 */
+				size_t size() const;
+
+				/**
+				 * Returns the amount of values stored per state
+				 * @return				int
+				 */
+				int getActionCount() const;
+
+				/**
+				 * Returns a state
+				 * @param	index		int			The index of the state in the table
+				 * @return				State&
+				 */
+				const State& operator[](int index) const;
+
+				/**
+				 * Returns the row of values of a state
+				 * @param	index		int			The index of the state in the table
+				 * @return				float*		getActionCount() contiguous values
+				 */
+				const float* getValues(int index) const;
+
+				/**
+				 * Returns the indices of all states ordered by the State comparison operators, evicted slots are left out
+				 * @return				std::vector<int>
+				 */
+				std::vector<int> sortedIndices() const;
+
+				/**
+				 * Returns the indices of the states changed since the previous snapshot taken with takeDirty,
+				 * empty if the snapshot wasn't taken with takeDirty
+				 * @return				std::vector<int>	Ascending indices
+				 */
+				const std::vector<int>& getDirty() const;
+
+				/**
+				 * Returns whether indices were reassigned (by clear() or removeIf()) since the previous snapshot taken with takeDirty.
+				 * getDirty() doesn't describe all changes then, only a complete copy of the snapshot does
+				 * @return				bool
+				 */
+				bool isReindexed() const;
+
+				/**
+				 * Adds the changes of an older snapshot to the ones of this snapshot, used when the older one is dropped
+				 * without being written. The values of this snapshot are newer, so they're valid for both
+				 * @param	older		Snapshot	The dropped snapshot
+				 * @return				void
+				 */
+				void mergeDirty(const Snapshot &older);
+		};
+
+	private:
+
+		/**
+		 * CHUNK_SIZE states and their rows, allocated at once and never moved
+		 */
+		struct Chunk{
+			//reserved to CHUNK_SIZE, so appending never reallocates
+			std::shared_ptr<std::vector<State>>	states;
+			std::shared_ptr<std::vector<float>>	values;
+
+			//whether a snapshot may still hold the buffers, the values are copied before they're written then
+			bool								shared;
+
+			//whether a snapshot may still hold the states, they're copied before a slot is evicted or reused then
+			bool								statesShared;
+
+			//one bit per state, set when the state is appended or written
+			std::vector<std::atomic<uint64_t>>	dirty;
+
+			//how often every state was visited (halved by every eviction pass) and the epoch it was visited last
+			std::vector<std::atomic<uint32_t>>	visits;
+			std::vector<std::atomic<uint32_t>>	lastVisits;
+		};
+
+		/**
+		 * One part of the hash index, the shard of a key is picked by its hash
+		 */
+		struct alignas(64) Shard{
+			std::mutex							lock;
+			KeyIndex							indices;
+		};
+
+		/**
+		 * A lock padded to its own cache line
+		 */
+		struct alignas(64) RowLock{
+			std::mutex							lock;
+		};
+
+		/**
+		 * A thread holding indices between its calls, e.g. an agent with a trace
+		 */
+		struct alignas(64) Reader{
+			std::atomic<bool>					active;
+
+			//the reader holds no index it got before this epoch anymore
+			std::atomic<uint32_t>				published;
+
+			//only used by the reader itself: the epoch it saw last and the amount of decisions since
+			uint32_t							observed;
+			size_t								decisions;
+		};
+
+		//marks an evicted slot, no rounded state reaches these values
+		static const State						EVICTED;
+
+		Type									type;
+		Grid									grid;
+
+		int										actionCount;
+
+		//the amount of states stored, a state and its row are written completely before it's counted
+		std::atomic<size_t>						count;
+
+		//serializes appending states, lookups of known states never take it
+		std::mutex								appendLock;
+
+		//the chunks in insertion order, MAX_CHUNKS slots allocated up front so they never move. An index stays valid until clear() or removeIf() is called
+		std::vector<std::unique_ptr<Chunk>>		chunks;
+
+		//maps State::getKey() to the index of the state (all states if SPARSE, the ones outside of the grid if DENSE)
+		mutable std::vector<Shard>				shards;
+
+		//maps Grid::getCellIndex() to the index of the state, -1 if the cell wasn't visited yet (DENSE only)
+		std::vector<std::atomic<int>>			cells;
+
+		mutable std::vector<RowLock>			rowLocks;
+
+		//set by clear() and removeIf(), reset by snapshot(true) and clearDirty()
+		bool									reindexed;
+
+		//incremented after every eviction pass
+		std::atomic<uint32_t>					epoch;
+
+		mutable std::vector<Reader>				readers;
+
+		//evicted slots and the epoch they were evicted in, they become free once all readers passed that epoch
+		std::vector<std::pair<int, uint32_t>>	retiredSlots;
+
+		//slots append() reuses before growing the table
+		std::vector<int>						freeSlots;
+
+		//the amount of retired and free slots
+		std::atomic<size_t>						evictedCount;
+
+	public:
+
+		/**
+		 * Inits the table
+		 * @param	actionCount	int			The amount of values stored per state
+		 * @param	type		Type		SPARSE or DENSE
+		 * @param	grid		Grid		The grid covered by the dense index, ignored if SPARSE
+		 */
+		StateTable(int actionCount = 0, Type type = SPARSE, const Grid &grid = Grid());
+
+		/**
+		 * Looks up a state
+		 * @param	state		State		The state to look for
+		 * @return				int			The index of the state or -1 if it isn't known yet
+		 */
+		int find(const State &state) const;
+
+		/**
+		 * Looks up a state and appends it if it isn't known yet, the values of a new state are set to Action::DEFAULT_REWARD.
+		 * If multiple threads insert the same state at once, all of them get the same index
+		 * @param	state		State		The state to look for
+		 * @return				int			The (stable) index of the state
+		 */
+		int findOrInsert(const State &state);
+
+		/**
+		 * Appends a state without looking it up first, used to bulk load states known to be unique.
+		 * Not synchronized, no other thread may use the table meanwhile
+		 * @param	state		State		The state to append, it mustn't be in the table already
+		 * @return				int			The index of the state
+		 */
+		int appendUnique(const State &state);
+
+		/**
+		 * Returns the state stored at an index
+		 * @param	index		int			The index returned by find() or findOrInsert()
+		 * @return				State&
+		 */
+		State& operator[](int index);
+		const State& operator[](int index) const;
+
+		/**
+		 * Returns the row of values of a state, reading or writing it isn't synchronized with other threads
+		 * and writing it bypasses the copy-on-write of snapshots
+		 * @param	index		int			The index of the state
+		 * @return				float*		getActionCount() contiguous values
+		 */
+		float* getValues(int index);
+		const float* getValues(int index) const;
+
+		/**
+		 * Copies the row of values of a state while holding its lock
+		 * @param	index		int			The index of the state
+		 * @param	values		float*		Receives getActionCount() values
+		 * @return				void
+		 */
+		void copyValues(int index, float *values) const;
+
+		/**
+		 * Gets the expected reward if a specific action is taken
+		 * @param	index		int			The index of the state
+		 * @param	action		int			The ordinal of the action
+		 * @return				float		The expected reward
+		 */
+		float getValue(int index, int action) const;
+
+		/**
+		 * Sets the expected reward if a specific action is taken
+		 * @param	index		int			The index of the state
+		 * @param	action		int			The ordinal of the action
+		 * @param	value		float		The expected reward
+		 * @return				void
+		 */
+		void setValue(int index, int action, float value);
+
+		/**
+		 * Applies an affine map to the expected rewards of all actions while holding the lock of the row:
+		 * values[i] = scales[i] * values[i] + offsets[i]
+		 * @param	index		int			The index of the state
+		 * @param	scales		float*		The factors, one per action
+		 * @param	offsets		float*		The summands, one per action
+		 * @return				void
+		 */
+		void updateValues(int index, const float *scales, const float *offsets);
+
+		/**
+		 * Applies an affine map to the expected rewards of some actions while holding the lock of the row, the other actions are left alone:
+		 * values[actions[i]] = scales[i] * values[actions[i]] + offsets[i]
+		 * @param	index		int			The index of the state
+		 * @param	actions		int*		The ordinals of the actions, each at most once
+		 * @param	scales		float*		The factors, one per entry of actions
+		 * @param	offsets		float*		The summands, one per entry of actions
+		 * @param	count		int			The amount of actions
+		 * @return				void
+		 */
+		void updateValues(int index, const int *actions, const float *scales, const float *offsets, int count);
+
+		/**
+		 * Gets the "general" value, the highest value of all actions
+		 * @param	index		int			The index of the state
+		 * @return				float		The expected reward
+		 */
+		float getGeneralValue(int index) const;
+
+		/**
+		 * Returns the amount of values stored per state
+		 * @return				int
+		 */
+		int getActionCount() const;
+
+		/**
+		 * Returns the amount of states stored
+		 * @return				size_t
+		 */
+		size_t size() const;
+
+		/**
+		 * Returns the amount of indices handed out so far, every index below is either a state or an evicted slot
+		 * @return				size_t
+		 */
+		size_t getIndexCount() const;
+
+		/**
+		 * Returns whether a slot was evicted, the state stored there isn't valid then
+		 * @param	state		State		The state stored at the index
+		 * @return				bool
+		 */
+		static bool isEvicted(const State &state);
+
+		/**
+		 * Counts a visit of a state, the evictor prefers states that were visited rarely and long ago
+		 * @param	index		int			The index of the state
+		 * @return				void
+		 */
+		void visit(int index);
+
+		/**
+		 * Returns how often a state was visited, halved by every eviction pass
+		 * @param	index		int			The index of the state
+		 * @return				uint32_t
+		 */
+		uint32_t getVisits(int index) const;
+
+		/**
+		 * Registers a thread holding indices between calls to the table, it has to call quiesce() regularly
+		 * @return				int			The reader id
+		 */
+		int registerReader();
+
+		/**
+		 * Unregisters a reader, it mustn't use any index it got before anymore
+		 * @param	reader		int			The reader id
+		 * @return				void
+		 */
+		void unregisterReader(int reader);
+
+		/**
+		 * Marks a quiescent point of a reader: it doesn't hold any index it didn't get during its last heldDecisions decisions,
+		 * e.g. an agent at the start of think() only holds the indices in its trace
+		 * @param	reader			int			The reader id
+		 * @param	heldDecisions	size_t		The amount of decisions the reader keeps indices of
+		 * @return					void
+		 */
+		void quiesce(int reader, size_t heldDecisions);
+
+		/**
+		 * Evicts states that no reader visited since it passed the current epoch and that match a predicate, at most limit of them.
+		 * Only one state is locked at a time, so an insert waits at most for one eviction. Every state looked at
+		 * and kept has its visits halved, also once the limit is reached. Has to be called by one thread at a time
+		 * @param	begin		int			The first index to look at
+		 * @param	end			int			One past the last index to look at
+		 * @param	predicate	std::function<bool(int, uint32_t)>	Gets the index and the visits of a cold state, returns true if it may be evicted
+		 * @param	limit		size_t		The maximum amount of states to evict
+		 * @return				size_t		The amount of states evicted
+		 */
+		size_t evict(int begin, int end, const std::function<bool(int, uint32_t)> &predicate, size_t limit);
+
+		/**
+		 * Frees the slots evicted before the epoch all readers passed and advances the epoch, called after every eviction pass
+		 * @return				size_t		The amount of slots freed
+		 */
+		size_t reclaim();
+
+		/**
+		 * Estimates how many states fit into an amount of memory
+		 * @param	bytes		size_t		The amount of memory
+		 * @return				size_t
+		 */
+		size_t getStateCapacity(size_t bytes) const;
+
+		/**
+		 * Reserves space for a specific amount of states
+		 * @param	amount		size_t		The amount of states to reserve space for
+		 * @return				void
+		 */
+		void reserve(size_t amount);
+
+		/**
+		 * Removes all states
+		 * @return				void
+		 */
+		void clear();
+
+		/**
+		 * Removes all states matching a predicate. This is the only operation (besides clear) that reassigns indices
+		 * @param	predicate	std::function<bool(int)>	Gets the current index of a state, returns true if it should be removed
+		 * @return				size_t						The amount of states removed
+		 */
+		size_t removeIf(std::function<bool(int)> predicate);
+
+		/**
+		 * Freezes the current states and values. Blocks all value accessors for a moment, but copies nothing
+		 * @param	takeDirty	bool		Whether the snapshot receives the dirty states, they're unmarked in the table
+		 * @return				Snapshot
+		 */
+		Snapshot snapshot(bool takeDirty = false);
+
+		/**
+		 * Unmarks all dirty states, used once the table matches the policies stored on disk again
+		 * @return				void
+		 */
+		void clearDirty();
+
+		/**
+		 * Returns the indices of all states ordered by the State comparison operators,
+		 * used when exporting the table
+		 * @return				std::vector<int>
+		 */
+		std::vector<int> sortedIndices() const;
+
+		/**
+		 * Returns the type of the table
+		 * @return				Type
+		 */
+		Type getType() const;
+
+		/**
+		 * Returns the name of a table type as used on the command line
+		 * @param	type		Type		The type to name
+		 * @return				std::string
+		 */
+		static std::string getTypeName(Type type);
+
+		/**
+		 * Estimates the amount of memory used by the table
+		 * @return				size_t		The estimated amount of bytes
+		 */
+		size_t getMemoryUsage() const;
+
+	private:
+
+		/**
+		 * Returns the shard holding a key
+		 * @param	key			uint64_t	The key of the state
+		 * @return				Shard&
+		 */
+		Shard& getShard(uint64_t key) const;
+
+		/**
+		 * Returns the lock guarding the row of a state
+		 * @param	index		int			The index of the state
+		 * @return				std::mutex&
+		 */
+		std::mutex& getRowLock(int index) const;
+
+		/**
+		 * Returns the lowest epoch any reader holds indices of
+		 * @return				uint32_t
+		 */
+		uint32_t getSafeEpoch() const;
+
+		/**
+		 * Evicts one state if it's still stored at an index and wasn't visited since the safe epoch
+		 * @param	index		int			The index of the state
+		 * @param	state		State		The state expected at the index
+		 * @param	safeEpoch	uint32_t	The epoch returned by getSafeEpoch()
+		 * @return				bool		Whether the state was evicted
+		 */
+		bool evictState(int index, const State &state, uint32_t safeEpoch);
+
+		/**
+		 * Locks the row of a state for writing, copies the chunk first if a snapshot shares it
+		 * @param	index		int								The index of the state
+		 * @param	lock		std::unique_lock<std::mutex>	Receives the lock of the row
+		 * @return				float*							The row of values
+		 */
+		float* lockValuesForWrite(int index, std::unique_lock<std::mutex> &lock);
+
+		/**
+		 * Gives a chunk its own copy of the values if a snapshot shares them. Has to be called while holding appendLock
+		 * @param	chunk		Chunk		The chunk to copy
+		 * @return				void
+		 */
+		void unshare(Chunk &chunk);
+
+		/**
+		 * Gives a chunk its own copy of the states if a snapshot shares them. Has to be called while holding appendLock
+		 * @param	chunk		Chunk		The chunk to copy
+		 * @return				void
+		 */
+		void unshareStates(Chunk &chunk);
+
+		/**
+		 * Takes or releases all row locks, in the same order every time
+		 * @return				void
+		 */
+		void lockRows();
+		void unlockRows();
+
+		/**
+		 * Marks a state as dirty
+		 * @param	index		int			The index of the state
+		 * @return				void
+		 */
+		void markDirty(int index);
+
+		/**
+		 * Unmarks all states, has to be called while holding appendLock and all row locks or without any other thread using the table
+		 * @param	dirty		std::vector<int>*	Receives the indices of the states that were dirty, may be NULL
+		 * @return				void
+		 */
+		void collectDirty(std::vector<int> *dirty);
+
+		/**
+		 * Allocates a chunk if it doesn't exist yet
+		 * @param	chunk		int			The position of the chunk
+		 * @return				void
+		 */
+		void allocateChunk(int chunk);
+
+		/**
+		 * Appends a state, reusing a free slot or allocating a new chunk if needed. Has to be called while holding appendLock
+		 * @param	state		State		The state to append
+		 * @return				int			The index of the new state
+		 */
+		int append(const State &state);
+
+		/**
+		 * Rebuilds the hash index and the dense index from the states
+		 * @return				void
+		 */
+		void reindex();
+};
+
+#endif /* AGENT_STATETABLE_H_ */
@@ -0,0 +1,199 @@
+/*
+ * TraceBuffer.cpp
+ *
+ * The eligibility traces of the agent: the last actions taken, each with a weight decaying with its age
+ */
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+#include "TraceBuffer.h"
+#include "StateTable.h"
+#include "ValueKernels.h"
+
+const float TraceBuffer::DEFAULT_DECAY	= 1.0f;
+const float TraceBuffer::MIN_TRACE		= 0.01f;
+
+/**
+ * Calculates the weights of all ages that aren't negligible, at most capacity
+ */
+static std::vector<float> traceWeights(int capacity, float decay){
+	std::vector<float>	weights;
+	float				weight = 1.0f;
+
+	for(int age=0;age<capacity && weight >= TraceBuffer::MIN_TRACE;age++){
+		weights.push_back(weight);
+		weight *= decay;
+	}
+
+	return weights;
+}
+
+/**
+ * Returns the smallest power of two greater or equal to n
+ */
+static size_t nextPowerOfTwo(size_t n){
+	size_t p = 1;
+
+	while(p < n){
+		p <<= 1;
+	}
+
+	return p;
+}
+
+TraceBuffer::TraceBuffer(int capacity, float decay) :
+		weights(traceWeights(capacity, decay)),
+		entries(weights.size()),
+		slots(nextPowerOfTwo(2 * weights.size() + 1)),
+		slotStamps(slots.size(), 0),
+		stamp(0),
+		rowStates(weights.size()),
+		rowHeads(weights.size()),
+		distinctActions(weights.size()),
+		distinctNext(weights.size()),
+		distinctScales(weights.size()),
+		distinctOffsets(weights.size()),
+		groupActions(weights.size()),
+		groupScales(weights.size()),
+		groupOffsets(weights.size()){
+}
+
+void TraceBuffer::push(int stateIndex, int action){
+	entries.push_back(std::make_pair(stateIndex, action));
+}
+
+void TraceBuffer::backup(StateTable &states, const float *rewards, int rewardCount, float fraction, float target){
+	int rowCount		= 0;
+	int distinctCount	= 0;
+	size_t mask			= slots.size() - 1;
+
+	//a new stamp invalidates all slots of the last backup without clearing them
+	if(++stamp == 0){
+		std::fill(slotStamps.begin(), slotStamps.end(), 0);
+		stamp = 1;
+	}
+
+	int					last			= -1;
+	std::pair<int, int>	lastEntry;
+	float				foldedWeight	= -1.0f;
+	float				scale, offset;
+
+	//the map of the current run of traces of the same action, composed into its distinct entry once the run ends
+	float				runScale		= 1.0f;
+	float				runOffset		= 0.0f;
+
+	//compose the maps of all traces of the same action, the oldest first, like applying them one after the other
+	for(size_t i=0;i<entries.size();i++){
+		const std::pair<int, int>	&entry	= entries[i];
+		float						weight	= weights[entries.size() - 1 - i];
+
+		//without decay all traces have the same weight and share one map
+		if(weight != foldedWeight){
+			ValueKernels::foldBackup(rewards, rewardCount, fraction * weight, target, scale, offset);
+			foldedWeight = weight;
+		}
+
+		//the ball often stays inside of the same state, so most traces continue the run and skip the lookup
+		if(last < 0 || lastEntry != entry){
+			if(last >= 0){
+				distinctScales[last]	= runScale * distinctScales[last];
+				distinctOffsets[last]	= runScale * distinctOffsets[last] + runOffset;
+			}
+
+			size_t slot = (size_t)(((uint64_t)(uint32_t) entry.first * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+
+			while(slotStamps[slot] == stamp && rowStates[slots[slot]] != entry.first){
+				slot = (slot + 1) & mask;
+			}
+
+			if(slotStamps[slot] != stamp){
+				slotStamps[slot]		= stamp;
+				slots[slot]				= rowCount;
+
+				rowStates[rowCount]		= entry.first;
+				rowHeads[rowCount]		= -1;
+				rowCount++;
+			}
+
+			//a row holds only the few actions traced in its state
+			int row	= slots[slot];
+			int j	= rowHeads[row];
+
+			while(j >= 0 && distinctActions[j] != entry.second){
+				j = distinctNext[j];
+			}
+
+			if(j < 0){
+				j						= distinctCount++;
+
+				distinctActions[j]		= entry.second;
+				distinctScales[j]		= 1.0f;
+				distinctOffsets[j]		= 0.0f;
+				distinctNext[j]			= rowHeads[row];
+				rowHeads[row]			= j;
+			}
+
+			last		= j;
+			lastEntry	= entry;
+			runScale	= 1.0f;
+			runOffset	= 0.0f;
+		}
+
+		runScale	= scale * runScale;
+		runOffset	= scale * runOffset + offset;
+	}
+
+	if(last >= 0){
+		distinctScales[last]	= runScale * distinctScales[last];
+		distinctOffsets[last]	= runScale * distinctOffsets[last] + runOffset;
+	}
+
+	//the row maps are sized once, the table of an agent never changes
+	if(rowScales.size() != (size_t) states.getActionCount()){
+		rowScales.resize(states.getActionCount());
+		rowOffsets.resize(states.getActionCount());
+	}
+
+	//and apply them row by row, every row is locked on its own as other agents may share the table
+	for(int row=0;row<rowCount;row++){
+		int count = 0;
+
+		for(int j=rowHeads[row];j>=0;j=distinctNext[j]){
+			groupActions[count]		= distinctActions[j];
+			groupScales[count]		= distinctScales[j];
+			groupOffsets[count]		= distinctOffsets[j];
+			count++;
+		}
+
+		//a full row covers every action, so it needs no identity for the others and can go through the kernel
+		if(count == (int) rowScales.size()){
+			for(int k=0;k<count;k++){
+				rowScales[groupActions[k]]	= groupScales[k];
+				rowOffsets[groupActions[k]]	= groupOffsets[k];
+			}
+
+			states.updateValues(rowStates[row], rowScales.data(), rowOffsets.data());
+		}else{
+			states.updateValues(rowStates[row], groupActions.data(), groupScales.data(), groupOffsets.data(), count);
+		}
+	}
+}
+
+size_t TraceBuffer::size() const{
+	return entries.size();
+}
+
+size_t TraceBuffer::capacity() const{
+	return entries.capacity();
+}
+
+const std::pair<int, int>& TraceBuffer::operator[](size_t i) const{
+	return entries[i];
+}
+
+void TraceBuffer::clear(){
+	entries.clear();
+}
@@ -0,0 +1,111 @@
+/*
+ * TraceBuffer.h
+ *
+ * The eligibility traces of the agent: the last actions taken, each with a weight decaying with its age
+ */
+
+#ifndef AGENT_TRACEBUFFER_H_
+#define AGENT_TRACEBUFFER_H_
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include "RingBuffer.h"
+#include "StateTable.h"
+
+class TraceBuffer{
+
+	public:
+
+		static const float					DEFAULT_DECAY;
+		static const float					MIN_TRACE;
+
+	private:
+
+		//decay^age for every age that is still above MIN_TRACE, the amount of them is the capacity of the buffer
+		std::vector<float>					weights;
+
+		//pairs of the state index and the ordinal of the action taken, the oldest first
+		RingBuffer<std::pair<int, int>>		entries;
+
+		//scratch space of backup(), preallocated so a backup never allocates
+		std::vector<int>					slots;
+		std::vector<uint32_t>				slotStamps;
+		uint32_t							stamp;
+
+		//the rows traced, found through the slots by their state index, each with a list of its distinct actions
+		std::vector<int>					rowStates;
+		std::vector<int>					rowHeads;
+
+		//the distinct actions, each with the next one of the same row (-1 ends the list) and its composed map
+		std::vector<int>					distinctActions;
+		std::vector<int>					distinctNext;
+		std::vector<float>					distinctScales;
+		std::vector<float>					distinctOffsets;
+
+		//the maps of one row: the traced actions only, or all actions if every action of the row was traced
+		std::vector<int>					groupActions;
+		std::vector<float>					groupScales;
+		std::vector<float>					groupOffsets;
+		std::vector<float>					rowScales;
+		std::vector<float>					rowOffsets;
+
+	public:
+
+		/**
+		 * Inits the buffer
+		 * @param	capacity	int			The maximum amount of actions traced
+		 * @param	decay		float		The factor the weight of a trace is multiplied with on every new action, 1.0 = no decay
+		 */
+		TraceBuffer(int capacity, float decay = DEFAULT_DECAY);
+
+		/**
+		 * Traces an action, the oldest trace is dropped once the buffer is full or its weight would fall below MIN_TRACE
+		 * @param	stateIndex	int			The index of the state the action was taken in
+		 * @param	action		int			The ordinal of the action
+		 * @return				void
+		 */
+		void push(int stateIndex, int action);
+
+		/**
+		 * Moves the value of every traced action by fraction * weight towards every reward (in order) and then towards the target.
+		 * All rewards are folded into one affine map per trace, an action traced multiple times gets the maps of all its traces.
+		 * The maps of all actions of a state are applied to its row at once with one lock: to just the traced actions,
+		 * or with ValueKernels::affine if every action of the row was traced
+		 * @param	states		StateTable	The table holding the values
+		 * @param	rewards		float*		The collected rewards
+		 * @param	rewardCount	int			The amount of rewards
+		 * @param	fraction	float		The fraction of the difference that is added to the value
+		 * @param	target		float		The value converged to after the rewards
+		 * @return				void
+		 */
+		void backup(StateTable &states, const float *rewards, int rewardCount, float fraction, float target);
+
+		/**
+		 * Returns the amount of actions traced
+		 * @return				size_t
+		 */
+		size_t size() const;
+
+		/**
+		 * Returns the maximum amount of actions traced, limited by the decay
+		 * @return				size_t
+		 */
+		size_t capacity() const;
+
+		/**
+		 * Returns a traced action, 0 is the oldest one
+		 * @param	i			size_t					The position of the trace
+		 * @return				std::pair<int, int>		The state index and the ordinal of the action
+		 */
+		const std::pair<int, int>& operator[](size_t i) const;
+
+		/**
+		 * Removes all traces
+		 * @return				void
+		 */
+		void clear();
+};
+
+#endif /* AGENT_TRACEBUFFER_H_ */
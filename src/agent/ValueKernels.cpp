@@ -0,0 +1,195 @@
+/*
+ * ValueKernels.cpp
+ *
+ * Vectorized loops over contiguous rows of values, used for the action selection and the value backup
+ */
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "ValueKernels.h"
+
+#if defined(__AVX2__)
+static const int LANES = 8;
+#elif defined(__SSE2__)
+static const int LANES = 4;
+#else
+static const int LANES = 1;
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+/**
+ * Returns the position of the n-th set bit of a mask, the mask has to have more than n bits set
+ */
+static int nthSetBit(unsigned mask, int n){
+	while(n-- > 0){
+		mask &= mask - 1; //clears the lowest set bit
+	}
+
+	return __builtin_ctz(mask);
+}
+#endif
+
+const char* ValueKernels::getInstructionSet(){
+#if defined(__AVX2__)
+	return "AVX2";
+#elif defined(__SSE2__)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+float ValueKernels::max(const float *values, int count, float floor){
+	int		i		= 0;
+	float	result	= floor;
+
+#if defined(__AVX2__)
+	if(count >= LANES){
+		__m256 m = _mm256_set1_ps(floor);
+
+		for(;i + LANES <= count;i += LANES){
+			m = _mm256_max_ps(m, _mm256_loadu_ps(values + i));
+		}
+
+		__m128 h = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+		h = _mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(1, 0, 3, 2)));
+		h = _mm_max_ss(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 3, 0, 1)));
+		result = _mm_cvtss_f32(h);
+	}
+#elif defined(__SSE2__)
+	if(count >= LANES){
+		__m128 m = _mm_set1_ps(floor);
+
+		for(;i + LANES <= count;i += LANES){
+			m = _mm_max_ps(m, _mm_loadu_ps(values + i));
+		}
+
+		m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_max_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		result = _mm_cvtss_f32(m);
+	}
+#endif
+
+	for(;i<count;i++){
+		if(values[i] > result){
+			result = values[i];
+		}
+	}
+
+	return result;
+}
+
+int ValueKernels::countEqual(const float *values, int count, float value){
+	int i = 0, equal = 0;
+
+#if defined(__AVX2__)
+	__m256 v = _mm256_set1_ps(value);
+
+	for(;i + LANES <= count;i += LANES){
+		equal += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), v, _CMP_EQ_OQ)));
+	}
+#elif defined(__SSE2__)
+	__m128 v = _mm_set1_ps(value);
+
+	for(;i + LANES <= count;i += LANES){
+		equal += __builtin_popcount(_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(values + i), v)));
+	}
+#endif
+
+	for(;i<count;i++){
+		if(values[i] == value){
+			equal++;
+		}
+	}
+
+	return equal;
+}
+
+int ValueKernels::findEqual(const float *values, int count, float value, int n){
+	int i = 0;
+
+#if defined(__AVX2__)
+	__m256 v = _mm256_set1_ps(value);
+
+	for(;i + LANES <= count;i += LANES){
+		unsigned	mask	= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), v, _CMP_EQ_OQ));
+		int			equal	= __builtin_popcount(mask);
+
+		if(n < equal){
+			return i + nthSetBit(mask, n);
+		}
+
+		n -= equal;
+	}
+#elif defined(__SSE2__)
+	__m128 v = _mm_set1_ps(value);
+
+	for(;i + LANES <= count;i += LANES){
+		unsigned	mask	= _mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(values + i), v));
+		int			equal	= __builtin_popcount(mask);
+
+		if(n < equal){
+			return i + nthSetBit(mask, n);
+		}
+
+		n -= equal;
+	}
+#endif
+
+	for(;i<count;i++){
+		if(values[i] == value && n-- == 0){
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void ValueKernels::affine(float *values, const float *scales, const float *offsets, int count){
+	int i = 0;
+
+#if defined(__AVX2__)
+	for(;i + LANES <= count;i += LANES){
+		__m256 v = _mm256_loadu_ps(values + i);
+
+	#if defined(__FMA__)
+		v = _mm256_fmadd_ps(_mm256_loadu_ps(scales + i), v, _mm256_loadu_ps(offsets + i));
+	#else
+		v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(scales + i), v), _mm256_loadu_ps(offsets + i));
+	#endif
+
+		_mm256_storeu_ps(values + i, v);
+	}
+#elif defined(__SSE2__)
+	for(;i + LANES <= count;i += LANES){
+		__m128 v = _mm_loadu_ps(values + i);
+
+		v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(scales + i), v), _mm_loadu_ps(offsets + i));
+
+		_mm_storeu_ps(values + i, v);
+	}
+#endif
+
+	for(;i<count;i++){
+		values[i] = scales[i] * values[i] + offsets[i];
+	}
+}
+
+void ValueKernels::foldBackup(const float *rewards, int rewardCount, float fraction, float target, float &scale, float &offset){
+	/*
+	 * One step is value + fraction * (reward - value) = (1 - fraction) * value + fraction * reward,
+	 * chaining the steps keeps the map affine
+	 */
+	scale	= 1.0f;
+	offset	= 0.0f;
+
+	for(int i=0;i<rewardCount;i++){
+		scale	= (1.0f - fraction) * scale;
+		offset	= (1.0f - fraction) * offset + fraction * rewards[i];
+	}
+
+	scale	= (1.0f - fraction) * scale;
+	offset	= (1.0f - fraction) * offset + fraction * target;
+}
@@ -0,0 +1,76 @@
+/*
+ * ValueKernels.h
+ *
+ * Vectorized loops over contiguous rows of values, used for the action selection and the value backup
+ *
+ * Compiled with AVX2 if __AVX2__ is defined (-mavx2), with SSE2 if __SSE2__ is defined (always the case on x86-64)
+ * and as plain scalar loops otherwise. All kernels work for any amount of values, the remainder is handled scalar
+ */
+
+#ifndef AGENT_VALUEKERNELS_H_
+#define AGENT_VALUEKERNELS_H_
+
+class ValueKernels{
+
+	public:
+
+		/**
+		 * Returns the name of the instruction set the kernels were compiled for
+		 * @return				const char*		"AVX2", "SSE2" or "scalar"
+		 */
+		static const char* getInstructionSet();
+
+		/**
+		 * Returns the highest value, but at least floor
+		 * @param	values		float*		The values to scan
+		 * @param	count		int			The amount of values
+		 * @param	floor		float		The lowest possible result
+		 * @return				float
+		 */
+		static float max(const float *values, int count, float floor);
+
+		/**
+		 * Counts the values equal to a specific value
+		 * @param	values		float*		The values to scan
+		 * @param	count		int			The amount of values
+		 * @param	value		float		The value to look for
+		 * @return				int
+		 */
+		static int countEqual(const float *values, int count, float value);
+
+		/**
+		 * Returns the position of the n-th value (starting at 0) equal to a specific value
+		 * @param	values		float*		The values to scan
+		 * @param	count		int			The amount of values
+		 * @param	value		float		The value to look for
+		 * @param	n			int			Which one of the equal values to return
+		 * @return				int			The position or -1 if there are less than n + 1 equal values
+		 */
+		static int findEqual(const float *values, int count, float value, int n);
+
+		/**
+		 * Applies an affine map to every value: values[i] = scales[i] * values[i] + offsets[i].
+		 * The value backup applies the folded maps of all traced actions of a state to its row with it
+		 * @param	values		float*		The values to adjust
+		 * @param	scales		float*		The factors
+		 * @param	offsets		float*		The summands
+		 * @param	count		int			The amount of values
+		 * @return				void
+		 */
+		static void affine(float *values, const float *scales, const float *offsets, int count);
+
+		/**
+		 * Folds the value backup of one traced action into a single affine map value -> scale * value + offset.
+		 * The backup moves the value by fraction towards every reward (in order) and then towards the target
+		 * @param	rewards		float*		The collected rewards
+		 * @param	rewardCount	int			The amount of rewards
+		 * @param	fraction	float		The fraction of the difference that is added to the value
+		 * @param	target		float		The value converged to after the rewards
+		 * @param	scale		float&		Receives the factor of the map
+		 * @param	offset		float&		Receives the summand of the map
+		 * @return				void
+		 */
+		static void foldBackup(const float *rewards, int rewardCount, float fraction, float target, float &scale, float &offset);
+};
+
+#endif /* AGENT_VALUEKERNELS_H_ */
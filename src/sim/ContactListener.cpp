@@ -8,7 +8,6 @@
 
 #include <functional>
 #include <random>
-#include <chrono>
 #include <stdio.h>
 
 #include "ContactListener.h"
@@ -21,15 +20,24 @@ const float ContactListener::KICKER_FORCE_Y_MAX		= 0.001f;
 
 const bool	ContactListener::RANDOM_KICKER_FORCE	= false;
 
-ContactListener::ContactListener(std::function<void(void)> gameOverCallback, std::function<void(float)> rewardCallback, bool randomKickerForce):
+ContactListener::ContactListener(std::function<void(void)> gameOverCallback, std::function<void(float)> rewardCallback, bool randomKickerForce, unsigned seed):
 	gameOverCallback(gameOverCallback),
 	rewardCallback(rewardCallback),
-	generator(seed()),
+	generator(seed),
+	profiler(nullptr),
 	randomKickerForce(randomKickerForce)
 	{};
 
-unsigned ContactListener::seed(){
-	return (unsigned) std::chrono::system_clock::now().time_since_epoch().count();
+const std::default_random_engine& ContactListener::getGenerator() const{
+	return generator;
+}
+
+void ContactListener::setGenerator(const std::default_random_engine &generator){
+	this->generator = generator;
+}
+
+void ContactListener::setProfiler(PhaseProfiler *profiler){
+	this->profiler = profiler;
 }
 
 float ContactListener::randomFloatInRange(const float &min, const float &max){
@@ -40,6 +48,7 @@ float ContactListener::randomFloatInRange(const float &min, const float &max){
 }
 
 void ContactListener::PreSolve(b2Contact* contact, const b2Manifold* oldManifold){
+	PhaseProfiler::Timer timer(profiler, PhaseProfiler::CONTACTS);
 
 	if(contact->IsEnabled()){
 		UserData *userDataA = (UserData*) contact->GetFixtureA()->GetBody()->GetUserData();
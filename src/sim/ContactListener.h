@@ -12,6 +12,8 @@
 
 #include <Box2D/Box2D.h>
 
+#include "../stats/PhaseProfiler.h"
+
 class ContactListener: public b2ContactListener{
 	private:
 
@@ -23,7 +25,9 @@ class ContactListener: public b2ContactListener{
 
 		std::default_random_engine			generator;
 
-		unsigned seed();
+		//times the callbacks, nullptr if not profiled
+		PhaseProfiler						*profiler;
+
 		float randomFloatInRange(const float &min, const float &max);
 
 	public:
@@ -31,7 +35,27 @@ class ContactListener: public b2ContactListener{
 		static const bool					RANDOM_KICKER_FORCE;
 		const bool							randomKickerForce;
 
-		ContactListener(std::function<void(void)> gameOverCallback, std::function<void(float)> rewardCallback, bool randomKickerForce);
+		ContactListener(std::function<void(void)> gameOverCallback, std::function<void(float)> rewardCallback, bool randomKickerForce, unsigned seed);
+
+		/**
+		 * Returns the generator of the random kicker force, part of Simulation::Snapshot
+		 * @return		std::default_random_engine
+		 */
+		const std::default_random_engine& getGenerator() const;
+
+		/**
+		 * Replaces the generator of the random kicker force
+		 * @param	generator	std::default_random_engine		The generator to continue with
+		 * @return				void
+		 */
+		void setGenerator(const std::default_random_engine &generator);
+
+		/**
+		 * Sets the profiler the callbacks are timed with
+		 * @param	profiler	PhaseProfiler*		The profiler, nullptr to stop timing
+		 * @return				void
+		 */
+		void setProfiler(PhaseProfiler *profiler);
 
 		/// This is called after a contact is updated. This allows you to inspect a
 		/// contact before it goes to the solver. If you are careful, you can modify the
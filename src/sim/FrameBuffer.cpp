@@ -0,0 +1,56 @@
+/*
+ * FrameBuffer.cpp
+ *
+ * Hands the latest frame of a simulation over to the thread rendering it, see FrameBuffer.h
+ */
+
+#include <Box2D/Box2D.h>
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+#include "FrameBuffer.h"
+
+const int FrameBuffer::FRESH		= 4;
+
+FrameBuffer::FrameBuffer() : back(0), front(1), ready(2){
+}
+
+FrameBuffer::Frame& FrameBuffer::getBack(){
+	return frames[back];
+}
+
+void FrameBuffer::publish(){
+	//the renderer can only take the frame once it's complete
+	back = ready.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+const FrameBuffer::Frame* FrameBuffer::acquire(){
+	if(ready.load(std::memory_order_relaxed) & FRESH){
+		front = ready.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+	}
+
+	//front is the initial empty frame until the first one was taken
+	return frames[front].transforms.empty() ? nullptr : &frames[front];
+}
+
+void FrameBuffer::capture(const b2World *world, Frame &frame){
+	size_t count = 0;
+
+	for(const b2Body *body = world->GetBodyList(); body; body = body->GetNext()){
+		if(body->GetType() == b2_staticBody){
+			continue;
+		}
+
+		if(count < frame.transforms.size()){
+			frame.transforms[count] = body->GetTransform();
+		}else{
+			frame.transforms.push_back(body->GetTransform());
+		}
+
+		count++;
+	}
+
+	frame.transforms.resize(count);
+}
@@ -0,0 +1,81 @@
+/*
+ * FrameBuffer.h
+ *
+ * Hands the latest frame of a simulation over to the thread rendering it. There are three frames: the simulation
+ * fills the back one and swaps it with the ready one, the renderer swaps the ready one with the front one it draws.
+ * Neither side ever waits for the other, frames the renderer is too slow for are skipped
+ */
+
+#ifndef SIM_FRAMEBUFFER_H_
+#define SIM_FRAMEBUFFER_H_
+
+#include <Box2D/Box2D.h>
+
+#include <vector>
+#include <atomic>
+
+class FrameBuffer{
+
+	public:
+
+		/**
+		 * What changes between two frames, the static bodies and all shapes are read from the world
+		 */
+		struct Frame{
+			//the transforms of all bodies that aren't static, in the order of the world's body list
+			std::vector<b2Transform>		transforms;
+
+			double							score;
+		};
+
+	private:
+
+		//set on ready once it holds a frame the renderer hasn't taken yet
+		static const int					FRESH;
+
+		Frame								frames[3];
+
+		//only touched by the simulation
+		int									back;
+
+		//only touched by the renderer
+		int									front;
+
+		//the frame in between, with FRESH
+		std::atomic<int>					ready;
+
+	public:
+
+		/**
+		 * Inits the buffer, acquire() returns nullptr until a frame was published
+		 */
+		FrameBuffer();
+
+		/**
+		 * Returns the frame the simulation fills next
+		 * @return				Frame&
+		 */
+		Frame& getBack();
+
+		/**
+		 * Makes the back frame the latest one, called by the simulation after filling it
+		 * @return				void
+		 */
+		void publish();
+
+		/**
+		 * Returns the latest frame published, it stays valid until the next call. Called by the renderer
+		 * @return				const Frame*	The frame, nullptr if none was published yet
+		 */
+		const Frame* acquire();
+
+		/**
+		 * Copies the transforms of the bodies that aren't static into a frame, reuses its memory
+		 * @param	world		b2World*		The world of the simulation
+		 * @param	frame		Frame			The frame to fill
+		 * @return				void
+		 */
+		static void capture(const b2World *world, Frame &frame);
+};
+
+#endif /* SIM_FRAMEBUFFER_H_ */
@@ -0,0 +1,323 @@
+/*
+ * Recorder.cpp
+ *
+ * Records rendered frames of an episode as a raw RGB stream or a PNG sequence, encoded on a background thread
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+#include <csignal>
+
+#include <sys/stat.h>
+
+#include "Recorder.h"
+
+const int Recorder::BUFFERS	= 8;
+
+/**
+ * Appends a big endian 32 bit integer
+ */
+static void appendUInt32(std::vector<uint8_t> &data, uint32_t value){
+	data.push_back(value >> 24);
+	data.push_back(value >> 16);
+	data.push_back(value >> 8);
+	data.push_back(value);
+}
+
+/**
+ * The CRC-32 of PNG chunks
+ */
+static uint32_t crc32(const uint8_t *data, size_t size){
+	//initialized once, thread safe as a static local
+	static const std::vector<uint32_t> table = []{
+		std::vector<uint32_t> table(256);
+
+		for(uint32_t n=0;n<256;n++){
+			uint32_t c = n;
+
+			for(int k=0;k<8;k++){
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+
+			table[n] = c;
+		}
+
+		return table;
+	}();
+
+	uint32_t c = 0xFFFFFFFFu;
+
+	for(size_t i=0;i<size;i++){
+		c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+	}
+
+	return c ^ 0xFFFFFFFFu;
+}
+
+/**
+ * Appends a chunk with its length and CRC
+ */
+static void appendChunk(std::vector<uint8_t> &png, const char *type, const std::vector<uint8_t> &data){
+	appendUInt32(png, data.size());
+
+	size_t start = png.size();
+
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data.begin(), data.end());
+
+	appendUInt32(png, crc32(&png[start], png.size() - start));
+}
+
+Recorder::Recorder(const std::string &path, Format format, int width, int height) :
+		path(path), format(format), width(width), height(height), stream(NULL), stopping(false), current(-1),
+		capturedFrames(0), encodedFrames(0), droppedFrames(0), captureDuration(0), encodeDuration(0){
+
+	if(format == RAW){
+		//a pipe whose reader went away must fail the write instead of killing the process
+		std::signal(SIGPIPE, SIG_IGN);
+
+		stream = fopen(path.c_str(), "wb");
+
+		if(stream == NULL){
+			printf("ERROR: Could not open %s for recording!\n", path.c_str());
+			return;
+		}
+	}else if(mkdir(path.c_str(), 0755) != 0 && errno != EEXIST){
+		printf("ERROR: Could not create the directory %s for recording!\n", path.c_str());
+		return;
+	}
+
+	buffers.resize(BUFFERS, std::vector<uint8_t>((size_t) width * height * 3));
+
+	for(int i=BUFFERS-1;i>=0;i--){
+		freeBuffers.push_back(i);
+	}
+
+	thread = std::thread(&Recorder::run, this);
+}
+
+Recorder::~Recorder(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+
+	changed.notify_all();
+
+	if(thread.joinable()){
+		thread.join();
+	}
+
+	if(stream != NULL){
+		fclose(stream);
+	}
+
+	if(isOpen()){
+		printf("Recorded %llu frames to %s, %llu dropped | %.3f ms per frame in the simulation, %.3f ms encoding in the background\n",
+				getEncodedFrames(), path.c_str(), getDroppedFrames(), getCaptureDuration(), getEncodeDuration());
+	}
+}
+
+bool Recorder::isOpen() const{
+	return !buffers.empty();
+}
+
+uint8_t* Recorder::beginFrame(){
+	if(buffers.empty()){
+		return nullptr;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if(freeBuffers.empty()){
+			droppedFrames.fetch_add(1);
+			return nullptr;
+		}
+
+		current = freeBuffers.back();
+		freeBuffers.pop_back();
+	}
+
+	captureStarted = std::chrono::steady_clock::now();
+
+	return buffers[current].data();
+}
+
+void Recorder::endFrame(bool keep){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if(keep){
+			pending.push_back(current);
+		}else{
+			freeBuffers.push_back(current);
+		}
+
+		current = -1;
+	}
+
+	changed.notify_one();
+
+	if(keep){
+		//only the simulation writes it, so there's no need for an atomic add
+		captureDuration.store(captureDuration.load() + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - captureStarted).count());
+		capturedFrames.fetch_add(1);
+	}
+}
+
+void Recorder::run(){
+	std::unique_lock<std::mutex> guard(lock);
+
+	while(true){
+		changed.wait(guard, [this]{
+			return stopping || !pending.empty();
+		});
+
+		if(pending.empty()){
+			break;
+		}
+
+		int buffer = pending.front();
+		pending.pop_front();
+
+		guard.unlock();
+
+		std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+		if(encode(buffers[buffer].data(), encodedFrames.load())){
+			encodeDuration.store(encodeDuration.load() + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+			encodedFrames.fetch_add(1);
+		}
+
+		guard.lock();
+
+		freeBuffers.push_back(buffer);
+	}
+}
+
+bool Recorder::encode(const uint8_t *pixels, unsigned long long index){
+	if(format == RAW){
+		size_t size = (size_t) width * height * 3;
+
+		if(fwrite(pixels, 1, size, stream) != size){
+			return false;
+		}
+
+		return fflush(stream) == 0;
+	}
+
+	char file[32];
+	snprintf(file, sizeof(file), "/frame_%06llu.png", index);
+
+	return writePNG(path + file, pixels, width, height);
+}
+
+bool Recorder::writePNG(const std::string &file, const uint8_t *pixels, int width, int height){
+	static const uint8_t	SIGNATURE[8]	= {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	static const size_t		MAX_BLOCK		= 65535;
+
+	size_t rowSize = (size_t) width * 3 + 1;
+	size_t rawSize = rowSize * height;
+
+	std::vector<uint8_t> png(SIGNATURE, SIGNATURE + 8);
+
+	std::vector<uint8_t> header;
+	appendUInt32(header, width);
+	appendUInt32(header, height);
+	header.push_back(8);	//bit depth
+	header.push_back(2);	//truecolor
+	header.push_back(0);	//deflate
+	header.push_back(0);	//no filtering beyond the per row filter type
+	header.push_back(0);	//not interlaced
+
+	appendChunk(png, "IHDR", header);
+
+	//zlib stream of stored deflate blocks, every row is prefixed with filter type 0
+	std::vector<uint8_t> data;
+	data.reserve(2 + rawSize + (rawSize / MAX_BLOCK + 1) * 5 + 4);
+	data.push_back(0x78);
+	data.push_back(0x01);
+
+	uint32_t	a			= 1;
+	uint32_t	b			= 0;
+	size_t		written		= 0;
+	size_t		blockLeft	= 0;
+
+	for(int y=0;y<height;y++){
+		const uint8_t *row = pixels + (size_t) y * width * 3;
+
+		for(size_t x=0;x<rowSize;x++){
+			if(blockLeft == 0){
+				size_t block = std::min(MAX_BLOCK, rawSize - written);
+
+				data.push_back(written + block == rawSize ? 1 : 0);
+				data.push_back(block & 0xFF);
+				data.push_back(block >> 8);
+				data.push_back(~block & 0xFF);
+				data.push_back((~block >> 8) & 0xFF);
+
+				blockLeft = block;
+			}
+
+			uint8_t value = x == 0 ? 0 : row[x - 1];
+
+			data.push_back(value);
+
+			a = (a + value) % 65521;
+			b = (b + a) % 65521;
+
+			written++;
+			blockLeft--;
+		}
+	}
+
+	appendUInt32(data, (b << 16) | a);
+
+	appendChunk(png, "IDAT", data);
+	appendChunk(png, "IEND", std::vector<uint8_t>());
+
+	FILE *out = fopen(file.c_str(), "wb");
+
+	if(out == NULL){
+		printf("ERROR: Could not write %s!\n", file.c_str());
+		return false;
+	}
+
+	bool complete = fwrite(png.data(), 1, png.size(), out) == png.size();
+
+	return fclose(out) == 0 && complete;
+}
+
+unsigned long long Recorder::getEncodedFrames() const{
+	return encodedFrames.load();
+}
+
+unsigned long long Recorder::getDroppedFrames() const{
+	return droppedFrames.load();
+}
+
+double Recorder::getCaptureDuration() const{
+	unsigned long long frames = capturedFrames.load();
+
+	return frames == 0 ? -1 : captureDuration.load() / frames;
+}
+
+double Recorder::getEncodeDuration() const{
+	unsigned long long frames = encodedFrames.load();
+
+	return frames == 0 ? -1 : encodeDuration.load() / frames;
+}
+
+std::string Recorder::getFormatName(Format format){
+	return format == PNG ? "png" : "raw";
+}
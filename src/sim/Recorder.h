@@ -0,0 +1,159 @@
+/*
+ * Recorder.h
+ *
+ * Records rendered frames of an episode, either as one raw RGB stream (a file or a named pipe, e.g. read by
+ * ffmpeg -f rawvideo -pix_fmt rgb24 -s WIDTHxHEIGHT) or as a numbered PNG sequence in a directory. The simulation
+ * only copies a frame into one of BUFFERS buffers, a background thread encodes and writes it. Once all buffers
+ * are waiting for the encoder, frames are dropped instead of stalling the simulation
+ */
+
+#ifndef SIM_RECORDER_H_
+#define SIM_RECORDER_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+class Recorder{
+
+	public:
+
+		enum Format{
+			RAW,	//packed RGB rows, one frame after another
+			PNG		//one frame_NNNNNN.png per frame
+		};
+
+		static const int					BUFFERS;
+
+	private:
+
+		const std::string					path;
+		const Format						format;
+		const int							width;
+		const int							height;
+
+		//the raw stream, NULL for PNG
+		FILE								*stream;
+
+		std::thread							thread;
+
+		std::vector<std::vector<uint8_t>>	buffers;
+
+		//guard freeBuffers, pending and stopping
+		std::mutex							lock;
+		std::condition_variable				changed;
+		std::vector<int>					freeBuffers;
+		std::deque<int>						pending;
+		bool								stopping;
+
+		//the buffer between beginFrame() and endFrame(), only touched by the simulation
+		int									current;
+		std::chrono::steady_clock::time_point	captureStarted;
+
+		std::atomic<unsigned long long>		capturedFrames;
+		std::atomic<unsigned long long>		encodedFrames;
+		std::atomic<unsigned long long>		droppedFrames;
+
+		//in milliseconds, summed over all frames
+		std::atomic<double>					captureDuration;
+		std::atomic<double>					encodeDuration;
+
+		/**
+		 * The loop of the encoder thread, drains the pending frames before it stops
+		 * @return				void
+		 */
+		void run();
+
+		/**
+		 * Writes a frame to the stream or the next PNG file
+		 * @param	pixels		uint8_t*	The packed RGB pixels
+		 * @param	index		unsigned long long	The number of the frame
+		 * @return				bool		Whether the frame was written
+		 */
+		bool encode(const uint8_t *pixels, unsigned long long index);
+
+		/**
+		 * Writes an uncompressed PNG (stored deflate blocks), so no image library is needed
+		 * @param	file		std::string	The file to write
+		 * @param	pixels		uint8_t*	The packed RGB pixels
+		 * @param	width		int			The width in pixels
+		 * @param	height		int			The height in pixels
+		 * @return				bool		Whether the file was written
+		 */
+		static bool writePNG(const std::string &file, const uint8_t *pixels, int width, int height);
+
+	public:
+
+		/**
+		 * Opens the stream or creates the directory and starts the encoder thread
+		 * @param	path		std::string	The file or pipe for RAW, the directory for PNG
+		 * @param	format		Format		How the frames are written
+		 * @param	width		int			The width of the frames in pixels
+		 * @param	height		int			The height of the frames in pixels
+		 */
+		Recorder(const std::string &path, Format format, int width, int height);
+
+		/**
+		 * Writes the pending frames, stops the encoder thread, closes the stream and prints how long the frames took
+		 */
+		~Recorder();
+
+		/**
+		 * Whether the stream or directory could be opened
+		 * @return				bool
+		 */
+		bool isOpen() const;
+
+		/**
+		 * Hands out a free buffer for the next frame and starts measuring the capture
+		 * @return				uint8_t*	width * height * 3 bytes to fill, nullptr if the frame has to be dropped
+		 */
+		uint8_t* beginFrame();
+
+		/**
+		 * Queues the buffer returned by beginFrame() for the encoder
+		 * @param	keep		bool		Whether the buffer was filled, it's handed back without being encoded otherwise
+		 * @return				void
+		 */
+		void endFrame(bool keep);
+
+		/**
+		 * Returns the amount of frames written so far
+		 * @return				unsigned long long
+		 */
+		unsigned long long getEncodedFrames() const;
+
+		/**
+		 * Returns the amount of frames dropped because the encoder fell behind
+		 * @return				unsigned long long
+		 */
+		unsigned long long getDroppedFrames() const;
+
+		/**
+		 * Returns how long the simulation spent on a frame on average, from beginFrame() to endFrame()
+		 * @return				double		The duration in milliseconds, -1 if nothing was captured yet
+		 */
+		double getCaptureDuration() const;
+
+		/**
+		 * Returns how long the encoder thread spent on a frame on average
+		 * @return				double		The duration in milliseconds, -1 if nothing was encoded yet
+		 */
+		double getEncodeDuration() const;
+
+		/**
+		 * Returns the name of a format as used on the command line
+		 * @param	format		Format		The format to name
+		 * @return				std::string
+		 */
+		static std::string getFormatName(Format format);
+};
+
+#endif /* SIM_RECORDER_H_ */
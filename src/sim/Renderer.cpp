@@ -5,6 +5,7 @@
  */
 
 #include <vector>
+#include <string>
 #include <stdio.h>
 #include <cmath>
 
@@ -18,6 +19,7 @@
 #include <SDL2/SDL2_gfxPrimitives.h>
 
 #include "Renderer.h"
+#include "FrameBuffer.h"
 #include "UserData.h"
 
 const float Renderer::NUMERATOR				= 7.0f;
@@ -37,7 +39,9 @@ b2Vec2 Renderer::toScreenCoords(const b2Vec2 &position){
 	);
 }
 
-Renderer::Renderer(int width, int height, const b2World *world) : width(width), height(height), font(NULL), world(world){
+Renderer::Renderer(int width, int height, const b2World *world, bool offscreen) :
+		width(width), height(height), window(NULL), surface(NULL), renderer(NULL), font(NULL), world(world), staticTexture(NULL), staticTextureValid(false),
+		cachedTextColor{0, 0, 0, 0}, cachedTextTexture(NULL), cachedTextWidth(0), cachedTextHeight(0){
 
 	if(TTF_Init()==-1) {
 		printf("TTF_Init: %s\n", TTF_GetError());
@@ -45,40 +49,53 @@ Renderer::Renderer(int width, int height, const b2World *world) : width(width),
 	}
 	font = TTF_OpenFont("opensans.ttf", 16);
 
-	SDL_Init( SDL_INIT_VIDEO );
-
-	if(SDL_GetNumVideoDisplays() > 1){
-		window = SDL_CreateWindow(
-			"PinballBot",						// window title
-			SDL_WINDOWPOS_CENTERED_DISPLAY(1),	// initial x position
-			SDL_WINDOWPOS_CENTERED_DISPLAY(1),	// initial y position
-			this->width,						// width, in pixels
-			this->height,						// height, in pixels
-			SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI //enables retina support
-		);
+	if(offscreen){
+		//a software renderer drawing into a surface needs neither a display nor a video driver
+		surface = SDL_CreateRGBSurfaceWithFormat(0, this->width, this->height, 32, SDL_PIXELFORMAT_ARGB8888);
+
+		if (surface == nullptr) {
+			printf("Could not create the offscreen surface: %s\n", SDL_GetError());
+			return;
+		}
+
+		renderer = SDL_CreateSoftwareRenderer(surface);
 	}else{
-		window = SDL_CreateWindow(
-			"PinballBot",						// window title
-			SDL_WINDOWPOS_CENTERED,				// initial x position
-			SDL_WINDOWPOS_CENTERED,				// initial y position
-			this->width,						// width, in pixels
-			this->height,						// height, in pixels
-			SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI //enables retina support
-		);
-	}
-
-	if (window == nullptr) {
-		printf("Could not create window: %s\n", SDL_GetError());
-		SDL_Quit();
-		return;
-	}
+		SDL_Init( SDL_INIT_VIDEO );
+
+		if(SDL_GetNumVideoDisplays() > 1){
+			window = SDL_CreateWindow(
+				"PinballBot",						// window title
+				SDL_WINDOWPOS_CENTERED_DISPLAY(1),	// initial x position
+				SDL_WINDOWPOS_CENTERED_DISPLAY(1),	// initial y position
+				this->width,						// width, in pixels
+				this->height,						// height, in pixels
+				SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI //enables retina support
+			);
+		}else{
+			window = SDL_CreateWindow(
+				"PinballBot",						// window title
+				SDL_WINDOWPOS_CENTERED,				// initial x position
+				SDL_WINDOWPOS_CENTERED,				// initial y position
+				this->width,						// width, in pixels
+				this->height,						// height, in pixels
+				SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI //enables retina support
+			);
+		}
+
+		if (window == nullptr) {
+			printf("Could not create window: %s\n", SDL_GetError());
+			SDL_Quit();
+			return;
+		}
 
-	//updates the width and height if there's a high DPI and calc other vars afterwards
-	SDL_GL_GetDrawableSize(window, &this->width, &this->height);
+		//updates the width and height if there's a high DPI and calc other vars afterwards
+		SDL_GL_GetDrawableSize(window, &this->width, &this->height);
+
+		renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
+	}
 
 	oneMeterInPX = round(SCALING * this->height); /* one meter is equal to the height */
 
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_ADD);
 
 	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); //white background
@@ -86,65 +103,187 @@ Renderer::Renderer(int width, int height, const b2World *world) : width(width),
 }
 
 Renderer::~Renderer(){
-	SDL_DestroyWindow(window);
-	SDL_Quit();
+	if(staticTexture != NULL){
+		SDL_DestroyTexture(staticTexture);
+	}
+
+	if(cachedTextTexture != NULL){
+		SDL_DestroyTexture(cachedTextTexture);
+	}
+
+	if(renderer != NULL){
+		SDL_DestroyRenderer(renderer);
+	}
+
+	if(surface != NULL){
+		SDL_FreeSurface(surface);
+	}else{
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+	}
 }
 
 void Renderer::render(const char* score){
 
+	bool cached = renderStaticTexture();
+
+	if(cached){
+		SDL_RenderCopy(renderer, staticTexture, NULL, NULL);
+	}else{
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); //white background
+		SDL_RenderClear(renderer);
+	}
+
 	drawText(score, 2, 2, 0, 0, 0, 1);
 
 	for(const b2Body *body = this->world->GetBodyList(); body; body = body->GetNext()){
+		if(!cached || body->GetType() != b2_staticBody){
+			drawBody(body, body->GetTransform());
+		}
+	}
+
+	this->redraw();
+}
+
+void Renderer::render(const FrameBuffer::Frame &frame){
+
+	bool cached = renderStaticTexture();
+
+	if(cached){
+		SDL_RenderCopy(renderer, staticTexture, NULL, NULL);
+	}else{
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); //white background
+		SDL_RenderClear(renderer);
+	}
+
+	drawText(std::to_string(frame.score).c_str(), 2, 2, 0, 0, 0, 1);
+
+	size_t next = 0;
+
+	for(const b2Body *body = this->world->GetBodyList(); body; body = body->GetNext()){
+		if(body->GetType() != b2_staticBody){
+			if(next < frame.transforms.size()){
+				drawBody(body, frame.transforms[next]);
+			}
 
-		UserData *userData = (UserData*) body->GetUserData();
-		if(!userData){
-			printf("DIDN'T DRAW! Body Position: X(%f), Y(%f); Type: N/A\n", body->GetPosition().x, body->GetPosition().y);
+			next++;
+		}else if(!cached){
+			drawBody(body, body->GetTransform());
 		}
+	}
+
+	this->redraw();
+}
+
+void Renderer::invalidateStaticTexture(){
+	staticTextureValid = false;
+}
 
-		for(const b2Fixture *fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext()){
+bool Renderer::renderStaticTexture(){
+	if(staticTextureValid){
+		return true;
+	}
 
-			b2Shape::Type shapeType = fixture->GetType();
+	if(staticTexture == NULL){
+		staticTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height);
 
-			if (shapeType == b2Shape::e_circle ){
-			    b2CircleShape* circleShape = (b2CircleShape*)fixture->GetShape();
+		if(staticTexture == NULL){
+			printf("Could not create the static texture, drawing every body every frame: %s\n", SDL_GetError());
+			return false;
+		}
 
-			    this->drawCircle(body->GetPosition(), circleShape->m_radius, userData->red, userData->green, userData->blue, userData->alpha, userData->filled);
-			}else if (shapeType == b2Shape::e_polygon ){
-			    b2PolygonShape* polygonShape = (b2PolygonShape*)fixture->GetShape();
+		//replaces the cleared frame completely, so it's copied without blending
+		SDL_SetTextureBlendMode(staticTexture, SDL_BLENDMODE_NONE);
+	}
 
-			    const b2Vec2 *vertices_orig = polygonShape->m_vertices;
+	if(SDL_SetRenderTarget(renderer, staticTexture) != 0){
+		printf("Could not render to the static texture, drawing every body every frame: %s\n", SDL_GetError());
 
-			    std::vector<b2Vec2> vertices(polygonShape->GetVertexCount());
-			    for(int i=0;i < polygonShape->GetVertexCount();i++){
-			    	vertices[i] = body->GetWorldPoint(vertices_orig[i]);
-			    }
+		SDL_DestroyTexture(staticTexture);
+		staticTexture = NULL;
 
-			    this->drawPolygon(vertices.data(), polygonShape->GetVertexCount(), userData->red, userData->green, userData->blue, userData->alpha, userData->filled);
-			}else if(shapeType == b2Shape::e_edge ){
-				 b2EdgeShape* edgeShape = (b2EdgeShape*)fixture->GetShape();
+		return false;
+	}
 
-				 drawLine(body->GetWorldPoint(edgeShape->m_vertex1), body->GetWorldPoint(edgeShape->m_vertex2), userData->red, userData->green, userData->blue, userData->alpha);
-			}else if(shapeType == b2Shape::e_chain){
-				 b2ChainShape* chainShape = (b2ChainShape*)fixture->GetShape();
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); //white background
+	SDL_RenderClear(renderer);
 
-				 for(int j=0;j < (chainShape->m_count - 1);j++){
-					 drawLine(body->GetWorldPoint(chainShape->m_vertices[j]), body->GetWorldPoint(chainShape->m_vertices[j+1]), userData->red, userData->green, userData->blue, userData->alpha);
-				 }
-			}else{
-				printf("Unknown shapeType: %d!", shapeType);
-			}
+	for(const b2Body *body = this->world->GetBodyList(); body; body = body->GetNext()){
+		if(body->GetType() == b2_staticBody){
+			drawBody(body, body->GetTransform());
 		}
 	}
 
-	this->redraw();
+	SDL_SetRenderTarget(renderer, NULL);
+
+	staticTextureValid = true;
+
+	return true;
+}
+
+void Renderer::drawBody(const b2Body *body, const b2Transform &transform){
+
+	UserData *userData = (UserData*) body->GetUserData();
+	if(!userData){
+		printf("DIDN'T DRAW! Body Position: X(%f), Y(%f); Type: N/A\n", transform.p.x, transform.p.y);
+		return;
+	}
+
+	for(const b2Fixture *fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext()){
+
+		b2Shape::Type shapeType = fixture->GetType();
+
+		if (shapeType == b2Shape::e_circle ){
+		    b2CircleShape* circleShape = (b2CircleShape*)fixture->GetShape();
+
+		    this->drawCircle(transform.p, circleShape->m_radius, userData->red, userData->green, userData->blue, userData->alpha, userData->filled);
+		}else if (shapeType == b2Shape::e_polygon ){
+		    b2PolygonShape* polygonShape = (b2PolygonShape*)fixture->GetShape();
+
+		    const b2Vec2 *vertices_orig = polygonShape->m_vertices;
+
+		    std::vector<b2Vec2> vertices(polygonShape->GetVertexCount());
+		    for(int i=0;i < polygonShape->GetVertexCount();i++){
+		    	vertices[i] = b2Mul(transform, vertices_orig[i]);
+		    }
+
+		    this->drawPolygon(vertices.data(), polygonShape->GetVertexCount(), userData->red, userData->green, userData->blue, userData->alpha, userData->filled);
+		}else if(shapeType == b2Shape::e_edge ){
+			 b2EdgeShape* edgeShape = (b2EdgeShape*)fixture->GetShape();
+
+			 drawLine(b2Mul(transform, edgeShape->m_vertex1), b2Mul(transform, edgeShape->m_vertex2), userData->red, userData->green, userData->blue, userData->alpha);
+		}else if(shapeType == b2Shape::e_chain){
+			 b2ChainShape* chainShape = (b2ChainShape*)fixture->GetShape();
+
+			 for(int j=0;j < (chainShape->m_count - 1);j++){
+				 drawLine(b2Mul(transform, chainShape->m_vertices[j]), b2Mul(transform, chainShape->m_vertices[j+1]), userData->red, userData->green, userData->blue, userData->alpha);
+			 }
+		}else{
+			printf("Unknown shapeType: %d!", shapeType);
+		}
+	}
 }
 
 void Renderer::redraw(){
 
 	SDL_RenderPresent(renderer);
+}
 
-	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-	SDL_RenderClear(renderer);
+bool Renderer::readPixels(uint8_t *pixels){
+	if(SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGB24, pixels, width * 3) != 0){
+		printf("Could not read the rendered frame: %s\n", SDL_GetError());
+		return false;
+	}
+
+	return true;
+}
+
+int Renderer::getWidth() const{
+	return width;
+}
+
+int Renderer::getHeight() const{
+	return height;
 }
 
 void Renderer::drawLine(const b2Vec2& p1, const b2Vec2& p2, Uint8 red, Uint8 green, Uint8 blue, Uint8 alpha){
@@ -183,19 +322,40 @@ void Renderer::drawCircle(const b2Vec2& center, float32 radius, Uint8 red, Uint8
 }
 
 void Renderer::drawText(const char* text, int posX, int posY, Uint8 red, Uint8 green, Uint8 blue, Uint8 alpha){
-	SDL_Surface* surface	= TTF_RenderText_Solid(font, text, {red, green, blue, alpha});
-	SDL_Texture* texture	= SDL_CreateTextureFromSurface(renderer, surface);
+	bool sameColor = cachedTextColor.r == red && cachedTextColor.g == green && cachedTextColor.b == blue && cachedTextColor.a == alpha;
 
-	SDL_FreeSurface(surface);
+	//the score only changes with a reward, most frames draw the same text again
+	if(cachedTextTexture == NULL || !sameColor || cachedText != text){
+		if(cachedTextTexture != NULL){
+			SDL_DestroyTexture(cachedTextTexture);
+			cachedTextTexture = NULL;
+		}
 
-	SDL_Rect rect;
-	rect.x = 50;
-	rect.y = 50;
-	rect.w = surface->w;
-	rect.h = surface->h;
+		cachedText			= text;
+		cachedTextColor		= {red, green, blue, alpha};
+
+		SDL_Surface* surface = TTF_RenderText_Solid(font, text, cachedTextColor);
+
+		if(surface == NULL){
+			return;
+		}
 
-	SDL_RenderCopy(renderer, texture, NULL, &rect);
+		cachedTextTexture	= SDL_CreateTextureFromSurface(renderer, surface);
+		cachedTextWidth		= surface->w;
+		cachedTextHeight	= surface->h;
 
-	SDL_DestroyTexture(texture);
+		SDL_FreeSurface(surface);
+
+		if(cachedTextTexture == NULL){
+			return;
+		}
+	}
+
+	SDL_Rect rect;
+	rect.x = posX;
+	rect.y = posY;
+	rect.w = cachedTextWidth;
+	rect.h = cachedTextHeight;
 
+	SDL_RenderCopy(renderer, cachedTextTexture, NULL, &rect);
 }
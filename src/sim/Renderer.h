@@ -7,7 +7,12 @@
 #ifndef SIM_RENDERER_H_
 #define SIM_RENDERER_H_
 
+#ifdef PINBALLBOT_HEADLESS
+#error "The renderer needs SDL, a headless build must not include it"
+#endif
+
 #include <vector>
+#include <string>
 
 #include <Box2D/Box2D.h>
 
@@ -18,6 +23,8 @@
 
 #include <SDL2/SDL2_gfxPrimitives.h>
 
+#include "FrameBuffer.h"
+
 class Renderer{
 
 	private:
@@ -34,12 +41,38 @@ class Renderer{
 		int		oneMeterInPX;
 
 		SDL_Window		*window;
+		SDL_Surface		*surface; //the target of an offscreen renderer, NULL if it renders into the window
 		SDL_Renderer	*renderer;
 
 		TTF_Font		*font;
 
 		const b2World	*world; //stores a pointer to the Box2D world
 
+		//the static bodies rasterized once, NULL if render targets aren't supported
+		SDL_Texture		*staticTexture;
+		bool			staticTextureValid;
+
+		//the last text drawn and its texture, it's only rendered again once the text or its color changes
+		std::string		cachedText;
+		SDL_Color		cachedTextColor;
+		SDL_Texture		*cachedTextTexture;
+		int				cachedTextWidth;
+		int				cachedTextHeight;
+
+		/**
+		 * Draws all fixtures of a body
+		 * @param	body		b2Body		The body to draw
+		 * @param	transform	b2Transform	Where the body is
+		 * @return				void
+		 */
+		void drawBody(const b2Body *body, const b2Transform &transform);
+
+		/**
+		 * Rasterizes the static bodies into staticTexture, creates it if needed
+		 * @return				bool		Whether the texture is ready to be copied
+		 */
+		bool renderStaticTexture();
+
 		/**
 		 * Converts Box2D meters into screen pixels
 		 * @param	meters		float		The amount of meters to convert
@@ -58,8 +91,12 @@ class Renderer{
 
 		/**
 		 * Inits all required values based on the given window width/height and the DPI
+		 * @param	width		int			The width of the window in pixels
+		 * @param	height		int			The height of the window in pixels
+		 * @param	world		b2World		The world to render
+		 * @param	offscreen	bool		Renders into a surface with the software renderer instead of a window, works without a display
 		 */
-		Renderer(int width, int height, const b2World *world);
+		Renderer(int width, int height, const b2World *world, bool offscreen = false);
 
 		/**
 		 * Uses SDL functions to remove objects
@@ -67,17 +104,51 @@ class Renderer{
 		~Renderer();
 
 		/**
-		 * Renders the Box2D world
+		 * Renders the Box2D world. The static bodies are only rasterized on the first frame and
+		 * after invalidateStaticTexture(), every other frame copies them and draws the moving bodies
 		 * @param	score			const char*
 		 */
 		void render(const char* score);
 
+		/**
+		 * Renders a frame captured by FrameBuffer::capture(), meanwhile another thread may step the world.
+		 * Only what never changes is read from the world: the body list, the body types, the shapes and the static bodies
+		 * @param	frame			FrameBuffer::Frame		The frame
+		 * @return	void
+		 */
+		void render(const FrameBuffer::Frame &frame);
+
+		/**
+		 * Rasterizes the static bodies again on the next frame, has to be called once they moved (e.g. a new pin field)
+		 * @return	void
+		 */
+		void invalidateStaticTexture();
+
 		/**
 		 * Redraws the scene onto the window
 		 * @return	void
 		 */
 		void redraw();
 
+		/**
+		 * Reads the last rendered frame back, meant for the offscreen renderer
+		 * @param	pixels			uint8_t*	Receives getWidth() * getHeight() packed RGB pixels, row by row
+		 * @return	bool			Whether the frame could be read
+		 */
+		bool readPixels(uint8_t *pixels);
+
+		/**
+		 * Returns the width of the frames in pixels
+		 * @return	int
+		 */
+		int getWidth() const;
+
+		/**
+		 * Returns the height of the frames in pixels
+		 * @return	int
+		 */
+		int getHeight() const;
+
 		/**
 		 * Draws a line
 		 * @param	p1				b2Vec2		The first point of the line
@@ -117,10 +188,10 @@ class Renderer{
 		void drawCircle(const b2Vec2& center, float32 radius, Uint8 red, Uint8 green, Uint8 blue, Uint8 alpha, bool filled);
 
 		/**
-		 * Draws text
-		 * @param	text			char*		The coordinates of the center of the circle
-		 * @param	posX			int			The radius of the circle
-		 * @param	posY			int			The radius of the circle
+		 * Draws text, the texture of the last text is reused while it doesn't change
+		 * @param	text			char*		The text to draw
+		 * @param	posX			int			The x coordinate of the top left corner in pixels
+		 * @param	posY			int			The y coordinate of the top left corner in pixels
 		 * @param	red				Uint8		The amount of red	in the color
 		 * @param	green			Uint8		The amount of green	in the color
 		 * @param	blue			Uint8		The amount of blue	in the color
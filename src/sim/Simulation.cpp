@@ -12,7 +12,6 @@
 #include <cmath>
 #include <functional>
 #include <random>
-#include <chrono>
 
 #include "../agent/State.h"
 
@@ -37,6 +36,8 @@ const float			Simulation::FIELD_SLOPE							= b2_pi / 6; //30 deg
  * VY:	0.0f - 9.9f [10^2 = 100 possibilities]
  *
  * Max amount of states: 43 * 26 * 100^2 = 11'180'000
+ *
+ * See getCaptureFrameGrid() for the grid used by the dense state table
  */
 
 const float			Simulation::FIELD_CAPTURE_X_MIN					= 0.0f;
@@ -100,15 +101,18 @@ const float			Simulation::FLIPPER_RIGHT_POS_X					= (3*FIELD_HEIGHT/8);
 const float			Simulation::FLIPPER_LEFT_POS_Y					= (7*FIELD_HEIGHT/8);
 const float			Simulation::FLIPPER_RIGHT_POS_Y					= (7*FIELD_HEIGHT/8);
 
-Simulation::Simulation(bool randomKickerForce):
-	contactListener(std::bind(&Simulation::gameOver, this), std::bind(&Simulation::getReward, this, std::placeholders::_1), randomKickerForce),
+Simulation::Simulation(bool randomKickerForce, uint64_t seed, int worker):
+	contactListener(std::bind(&Simulation::gameOver, this), std::bind(&Simulation::getReward, this, std::placeholders::_1), randomKickerForce,
+			Seeds::derive(seed, Seeds::KICKER, worker)),
 	gravity(GRAVITY_X, GRAVITY_Y),
 	world(this->gravity),
 	ballBody(NULL),
 	gameOverBody(NULL),
 	flipperLeftBody(NULL),
 	flipperRightBody(NULL),
+	isGameOver(false),
 	borderData(UserData::PINBALL_BORDER),
+	pinData(PIN_COUNT, UserData(UserData::PINBALL_PIN, 1.0f, true, 0, 0, 0)),
 	ballData(UserData::PINBALL_BALL),
 	kickerData(UserData::PINBALL_KICKER, 0, true, 128, 128, 128, 255),
 	gameOverData(UserData::PINBALL_GAMEOVER, -100, true, 231, 76, 60, 100),
@@ -118,7 +122,12 @@ Simulation::Simulation(bool randomKickerForce):
 		b2Vec2(3 * FIELD_WIDTH / 6, 2 * FIELD_HEIGHT / 8),
 		b2Vec2(2 * FIELD_WIDTH / 6, 3 * FIELD_HEIGHT / 8),
 		b2Vec2(4 * FIELD_WIDTH / 6, 3 * FIELD_HEIGHT / 8)
-	}{
+	},
+	pinGenerator(Seeds::derive(seed, Seeds::PINS, worker)),
+	profiler(nullptr),
+	roundedState(0, 0, 0, 0),
+	roundedVelocity(true),
+	reward(Action::DEFAULT_REWARD){
 
 	/* Initializes a world with gravity pulling downwards and add contact listener */
 	world.SetContactListener(&contactListener);
@@ -295,8 +304,13 @@ Simulation::Simulation(bool randomKickerForce):
 	flipperLeftRevJoint							= (b2RevoluteJoint*)this->world.CreateJoint(&flipperLeftRevJointDef);
 	flipperRightRevJoint						= (b2RevoluteJoint*)this->world.CreateJoint(&flipperRightRevJointDef);
 
+	createPins();
 	generateStaticPinField();
+
+	createBall();
 	respawnBall();
+
+	updateRoundedState();
 }
 
 const b2World* Simulation::getWorld(){
@@ -333,18 +347,12 @@ void Simulation::drawPlayingField(const b2Vec2* points){
 
 }
 
-void Simulation::respawnBall(){
+void Simulation::createBall(){
 
-	if(ballBody){
-		//if not a null pointer
-		world.DestroyBody(ballBody);
-	}
-
-	/* Init playing ball */
+	/* Init playing ball, respawnBall() moves it to the kicker */
 	b2BodyDef									ballDef;
 	ballDef.type								= b2_dynamicBody;
 	ballDef.bullet								= true; //exact calc of collisions
-	ballDef.position.Set(11 * FIELD_WIDTH / 12, 4 * FIELD_HEIGHT / 8);
 	ballBody									= world.CreateBody(&ballDef);
 
 	ballBody->SetUserData(&ballData);
@@ -362,25 +370,7 @@ void Simulation::respawnBall(){
 	this->ballBody->CreateFixture(&ballFixtureDef);
 }
 
-void Simulation::generateRandomPinField(){
-	std::default_random_engine generator(std::chrono::system_clock::now().time_since_epoch().count());
-	std::uniform_real_distribution<float> distribution_X = std::uniform_real_distribution<float>(PIN_BOUNDARY_X_MIN, PIN_BOUNDARY_X_MAX);
-	std::uniform_real_distribution<float> distribution_Y = std::uniform_real_distribution<float>(PIN_BOUNDARY_Y_MIN, PIN_BOUNDARY_Y_MAX);
-
-	int pins_generated = 0;
-	b2Vec2 v;
-	bool add;
-
-	for(int i=0;i<this->pinBodies.size();i++){
-		if(pinBodies[i]){
-			world.DestroyBody(pinBodies[i]);
-		}
-	}
-
-	std::vector<b2Vec2> pins(PIN_COUNT);
-	this->pinBodies	= std::vector<b2Body*>(PIN_COUNT);
-	this->pinData	= std::vector<UserData>(PIN_COUNT);
-
+void Simulation::createPins(){
 	b2BodyDef									pinDef;
 	pinDef.type									= b2_staticBody;
 
@@ -394,13 +384,40 @@ void Simulation::generateRandomPinField(){
 	pinFixtureDef.friction						= PIN_FRICTION;
 	pinFixtureDef.restitution					= PIN_RESTITUTION;
 
+	//pinData is never resized, so the pointers the bodies hold stay valid
+	this->pinBodies	= std::vector<b2Body*>(PIN_COUNT);
+
+	for(int i=0;i<PIN_COUNT;i++){
+		this->pinBodies[i] = world.CreateBody(&pinDef);
+		this->pinBodies[i]->SetUserData(&this->pinData[i]);
+		this->pinBodies[i]->CreateFixture(&pinFixtureDef);
+	}
+}
+
+void Simulation::respawnBall(){
+	//the contacts the ball had are dropped by the next step, the moved proxy doesn't overlap them anymore
+	ballBody->SetTransform(b2Vec2(11 * FIELD_WIDTH / 12, 4 * FIELD_HEIGHT / 8), 0.0f);
+	ballBody->SetLinearVelocity(b2Vec2(0.0f, 0.0f));
+	ballBody->SetAngularVelocity(0.0f);
+	ballBody->SetAwake(true);
+}
+
+void Simulation::generateRandomPinField(){
+	std::uniform_real_distribution<float> distribution_X = std::uniform_real_distribution<float>(PIN_BOUNDARY_X_MIN, PIN_BOUNDARY_X_MAX);
+	std::uniform_real_distribution<float> distribution_Y = std::uniform_real_distribution<float>(PIN_BOUNDARY_Y_MIN, PIN_BOUNDARY_Y_MAX);
+
+	int pins_generated = 0;
+	b2Vec2 v;
+	bool add;
+
 	while(pins_generated < PIN_COUNT){
 
-		v		= b2Vec2(distribution_X(generator), distribution_Y(generator));
+		v		= b2Vec2(distribution_X(pinGenerator), distribution_Y(pinGenerator));
 		add		= true;
 
+		//the pins before pins_generated were moved already
 		for(int i=0;i<pins_generated;i++){
-			if((pins[i] - v).Length() <= 6 * PIN_RADIUS){
+			if((pinBodies[i]->GetPosition() - v).Length() <= 6 * PIN_RADIUS){
 				add = false;
 				break;
 			}
@@ -408,11 +425,7 @@ void Simulation::generateRandomPinField(){
 
 		if(add){
 			//if it's the last one and is still valid add it
-			pinDef.position.Set(v.x, v.y);
-			this->pinBodies[pins_generated] = world.CreateBody(&pinDef);
-			this->pinData[pins_generated]	= UserData(UserData::PINBALL_PIN, 1.0f, true, 0, 0, 0);
-			this->pinBodies[pins_generated]->SetUserData(&this->pinData[pins_generated]);
-			this->pinBodies[pins_generated]->CreateFixture(&pinFixtureDef);
+			this->pinBodies[pins_generated]->SetTransform(v, 0.0f);
 			pins_generated++;
 		}
 
@@ -420,35 +433,8 @@ void Simulation::generateRandomPinField(){
 }
 
 void Simulation::generateStaticPinField(){
-	for(int i=0;i<this->pinBodies.size();i++){
-		if(pinBodies[i]){
-			world.DestroyBody(pinBodies[i]);
-		}
-	}
-
-	std::vector<b2Vec2> pins(PIN_COUNT);
-	this->pinBodies	= std::vector<b2Body*>(PIN_COUNT);
-	this->pinData	= std::vector<UserData>(PIN_COUNT);
-
-	b2BodyDef									pinDef;
-	pinDef.type									= b2_staticBody;
-
-	b2CircleShape								pinSphere;
-	pinSphere.m_p.Set(0.0f, 0.0f);
-	pinSphere.m_radius							= PIN_RADIUS;
-
-	b2FixtureDef								pinFixtureDef;
-	pinFixtureDef.shape							= &pinSphere;
-	pinFixtureDef.density						= PIN_DENSITY;
-	pinFixtureDef.friction						= PIN_FRICTION;
-	pinFixtureDef.restitution					= PIN_RESTITUTION;
-
-	for(int i=0;i<staticPlayingField.size();i++){
-		pinDef.position.Set(staticPlayingField[i].x, staticPlayingField[i].y);
-		this->pinBodies[i] = world.CreateBody(&pinDef);
-		this->pinData[i]	= UserData(UserData::PINBALL_PIN, 1.0f, true, 0, 0, 0);
-		this->pinBodies[i]->SetUserData(&this->pinData[i]);
-		this->pinBodies[i]->CreateFixture(&pinFixtureDef);
+	for(int i=0;i<this->pinBodies.size() && i<staticPlayingField.size();i++){
+		this->pinBodies[i]->SetTransform(staticPlayingField[i], 0.0f);
 	}
 }
 
@@ -464,12 +450,89 @@ void Simulation::step(const float32 &time_step){
 
 	reward = Action::DEFAULT_REWARD; //reset current reward
 
-	world.Step(time_step, VELOCITY_ITERATIONS, POSITION_ITERATIONS);//reward value is set in this call by the collision listener
+	{
+		PhaseProfiler::Timer timer(profiler, PhaseProfiler::WORLD_STEP);
+
+		world.Step(time_step, VELOCITY_ITERATIONS, POSITION_ITERATIONS);//reward value is set in this call by the collision listener
+	}
 
 	if(isGameOver){
 		respawnBall();
 		isGameOver = false;
 	}
+
+	PhaseProfiler::Timer timer(profiler, PhaseProfiler::STATE);
+
+	updateRoundedState();
+}
+
+void Simulation::setProfiler(PhaseProfiler *profiler){
+	this->profiler = profiler;
+	contactListener.setProfiler(profiler);
+}
+
+void Simulation::updateRoundedState(){
+	roundedState = getCurrentState(roundedVelocity);
+}
+
+const State& Simulation::getRoundedState() const{
+	return roundedState;
+}
+
+void Simulation::setRoundedVelocity(bool includeVelocity){
+	roundedVelocity = includeVelocity;
+	updateRoundedState();
+}
+
+Simulation::Snapshot Simulation::snapshot() const{
+	Snapshot snapshot;
+
+	saveBody(ballBody, snapshot.ball);
+	saveBody(flipperLeftBody, snapshot.flipperLeft);
+	saveBody(flipperRightBody, snapshot.flipperRight);
+
+	snapshot.flipperLeftMotor					= flipperLeftRevJoint->IsMotorEnabled();
+	snapshot.flipperRightMotor					= flipperRightRevJoint->IsMotorEnabled();
+
+	snapshot.isGameOver							= isGameOver;
+	snapshot.reward								= reward;
+
+	snapshot.kickerGenerator					= contactListener.getGenerator();
+
+	return snapshot;
+}
+
+void Simulation::restore(const Snapshot &snapshot){
+	restoreBody(ballBody, snapshot.ball);
+	restoreBody(flipperLeftBody, snapshot.flipperLeft);
+	restoreBody(flipperRightBody, snapshot.flipperRight);
+
+	flipperLeftRevJoint->EnableMotor(snapshot.flipperLeftMotor);
+	flipperRightRevJoint->EnableMotor(snapshot.flipperRightMotor);
+
+	isGameOver									= snapshot.isGameOver;
+	reward										= snapshot.reward;
+
+	contactListener.setGenerator(snapshot.kickerGenerator);
+
+	updateRoundedState();
+}
+
+void Simulation::saveBody(const b2Body *body, BodyState &state){
+	state.position								= body->GetPosition();
+	state.angle									= body->GetAngle();
+	state.linearVelocity						= body->GetLinearVelocity();
+	state.angularVelocity						= body->GetAngularVelocity();
+	state.awake									= body->IsAwake();
+}
+
+void Simulation::restoreBody(b2Body *body, const BodyState &state){
+	body->SetTransform(state.position, state.angle);
+	body->SetLinearVelocity(state.linearVelocity);
+	body->SetAngularVelocity(state.angularVelocity);
+
+	//setting a velocity wakes the body up
+	body->SetAwake(state.awake);
 }
 
 void Simulation::enableLeftFlipper(){
@@ -500,7 +563,30 @@ bool Simulation::isPlayingBallInsideCaptureFrame(){
 	return (pos.x > FIELD_CAPTURE_X_MIN && pos.x < FIELD_CAPTURE_X_MAX) && (pos.y > FIELD_CAPTURE_Y_MIN && pos.y < FIELD_CAPTURE_Y_MAX);
 }
 
-State Simulation::getCurrentState(std::vector<Action*> availableActions, bool includeVelocity){
-	return includeVelocity ? State(this->ballBody->GetPosition(), this->ballBody->GetLinearVelocity(), availableActions)
-			: State(this->ballBody->GetPosition(), b2Vec2(0, 0), availableActions);
+const b2Vec2& Simulation::getBallPosition() const{
+	return this->ballBody->GetPosition();
+}
+
+const b2Vec2& Simulation::getBallVelocity() const{
+	return this->ballBody->GetLinearVelocity();
+}
+
+float Simulation::getBallSpeed(){
+	return this->ballBody->GetLinearVelocity().Length();
+}
+
+State Simulation::getCurrentState(bool includeVelocity){
+	return includeVelocity ? State(this->ballBody->GetPosition(), this->ballBody->GetLinearVelocity())
+			: State(this->ballBody->GetPosition(), b2Vec2(0, 0));
+}
+
+StateTable::Grid Simulation::getCaptureFrameGrid(bool includeVelocity){
+	//roundVel() maps everything above the maximum to zero, so the velocity ranges from -max to +max
+	int maxVelocity = includeVelocity ? State::roundVel(State::MAX_ROUNDED_VALUE) : 0;
+
+	return StateTable::Grid(
+			State::roundPos(FIELD_CAPTURE_X_MIN), State::roundPos(FIELD_CAPTURE_X_MAX),
+			State::roundPos(FIELD_CAPTURE_Y_MIN), State::roundPos(FIELD_CAPTURE_Y_MAX),
+			-1 * maxVelocity, maxVelocity
+	);
 }
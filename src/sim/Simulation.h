@@ -11,8 +11,12 @@
 
 #include <vector>
 #include <cmath>
+#include <random>
 
 #include "../agent/State.h"
+#include "../agent/StateTable.h"
+#include "../agent/Seeds.h"
+#include "../stats/PhaseProfiler.h"
 
 #include "ContactListener.h"
 #include "UserData.h"
@@ -94,6 +98,35 @@ class Simulation{
 		static const float			FLIPPER_LEFT_POS_Y;
 		static const float			FLIPPER_RIGHT_POS_Y;
 
+		/**
+		 * The dynamic state of a body
+		 */
+		struct BodyState{
+			b2Vec2							position;
+			float32							angle;
+			b2Vec2							linearVelocity;
+			float32							angularVelocity;
+			bool							awake;
+		};
+
+		/**
+		 * Everything that changes while the simulation is stepped, plain values only so thousands of them can be kept
+		 * around. The static bodies, the fixtures and the pins never change and aren't part of it
+		 */
+		struct Snapshot{
+			BodyState						ball;
+			BodyState						flipperLeft;
+			BodyState						flipperRight;
+
+			bool							flipperLeftMotor;
+			bool							flipperRightMotor;
+
+			bool							isGameOver;
+			float							reward;
+
+			std::default_random_engine		kickerGenerator;
+		};
+
 	/* Then some private things */
 	private:
 
@@ -141,6 +174,50 @@ class Simulation{
 
 		std::vector<b2Vec2>								staticPlayingField;
 
+		//draws the positions of generateRandomPinField()
+		std::default_random_engine						pinGenerator;
+
+		//times step(), nullptr if not profiled
+		PhaseProfiler									*profiler;
+
+		//the state after the last step, rounded the way the agent sees it
+		State											roundedState;
+		bool											roundedVelocity;
+
+		/**
+		 * Creates the ball body, it's kept for the whole simulation and only moved by respawnBall()
+		 * @return				void
+		 */
+		void createBall();
+
+		/**
+		 * Creates the PIN_COUNT pin bodies, they're kept for the whole simulation and only moved by the pin field generators
+		 * @return				void
+		 */
+		void createPins();
+
+		/**
+		 * Rounds the current state into roundedState
+		 * @return				void
+		 */
+		void updateRoundedState();
+
+		/**
+		 * Copies the dynamic state of a body
+		 * @param	body		b2Body*			The body
+		 * @param	state		BodyState		Receives the state
+		 * @return				void
+		 */
+		static void saveBody(const b2Body *body, BodyState &state);
+
+		/**
+		 * Moves a body back to a saved state
+		 * @param	body		b2Body*			The body
+		 * @param	state		BodyState		The state
+		 * @return				void
+		 */
+		static void restoreBody(b2Body *body, const BodyState &state);
+
 	/* And last but not least the public functions */
 	public:
 
@@ -149,8 +226,11 @@ class Simulation{
 
 		/**
 		 * Inits the world and all of the needed objects
+		 * @param	randomKickerForce	bool		Whether the kicker applies a random force
+		 * @param	seed				uint64_t	The seed of the run, see Seeds
+		 * @param	worker				int			The worker the simulation belongs to, every worker draws from its own streams
 		 */
-		Simulation(bool randomKickerForce);
+		Simulation(bool randomKickerForce, uint64_t seed = Seeds::fromClock(), int worker = 0);
 
 		/**
 		 * Returns a reference to the Box2D world
@@ -165,19 +245,19 @@ class Simulation{
 		void drawPlayingField(const b2Vec2* points);
 
 		/**
-		 * Respawns the ball
+		 * Respawns the ball at the kicker, the body is moved and stopped instead of recreated
 		 * @return void
 		 */
 		void respawnBall();
 
 		/**
-		 * (Re-)Generates the pin field
+		 * (Re-)Generates the pin field by moving the existing pins to random positions
 		 * @return void
 		 */
 		void generateRandomPinField();
 
 		/**
-		 * Generates a static pin field
+		 * Moves the pins to the static pin field
 		 */
 		void generateStaticPinField();
 
@@ -201,6 +281,28 @@ class Simulation{
 		 */
 		void step(const float32 &time_step);
 
+		/**
+		 * Sets the profiler step() and the contact callbacks are timed with
+		 * @param	profiler	PhaseProfiler*	The profiler, nullptr to stop timing
+		 * @return	void
+		 */
+		void setProfiler(PhaseProfiler *profiler);
+
+		/**
+		 * Copies the dynamic state of the simulation, see Snapshot
+		 * @return	Snapshot
+		 */
+		Snapshot snapshot() const;
+
+		/**
+		 * Restores a snapshot of this or another simulation in place, no body is recreated.
+		 * Box2D keeps the contacts of the moved bodies and warm starts them with their old impulses, so
+		 * a rollout from a restored snapshot is physically valid but not bit-identical to the original run
+		 * @param	snapshot	Snapshot		The snapshot to restore
+		 * @return	void
+		 */
+		void restore(const Snapshot &snapshot);
+
 		/**
 		 * Activates the left hand flipper. Will stay active until disableLeftFlipper() is called
 		 * @return	void
@@ -236,13 +338,51 @@ class Simulation{
 		 */
 		bool isPlayingBallInsideCaptureFrame();
 
+		/**
+		 * Returns the state after the last step, it's rounded as part of step() already.
+		 * Equal to getCurrentState(), see setRoundedVelocity()
+		 * @return const State&
+		 */
+		const State& getRoundedState() const;
+
+		/**
+		 * Sets whether getRoundedState() includes the velocity, it does by default
+		 * @param includeVelocity	bool					Whether the velocity should be empty (false) or not (true)
+		 * @return void
+		 */
+		void setRoundedVelocity(bool includeVelocity);
+
+		/**
+		 * Returns the position of the playing ball, not rounded
+		 * @return const b2Vec2&
+		 */
+		const b2Vec2& getBallPosition() const;
+
+		/**
+		 * Returns the velocity of the playing ball, not rounded
+		 * @return const b2Vec2&
+		 */
+		const b2Vec2& getBallVelocity() const;
+
+		/**
+		 * Returns the speed of the playing ball
+		 * @return float		The speed in m/s
+		 */
+		float getBallSpeed();
+
 		/**
 		 * Returns the current state
-		 * @param availableActions	std::vector<Action*>	The actions for which the deault reward should be set
 		 * @param includeVelocity	bool					Whether the velocity should be empty (false) or not (true)
 		 * @return State
 		 */
-		State getCurrentState(std::vector<Action*> availableActions = std::vector<Action*>(0), bool includeVelocity = true);
+		State getCurrentState(bool includeVelocity = true);
+
+		/**
+		 * Returns the grid of rounded states the ball can reach inside the capture frame
+		 * @param includeVelocity	bool					Whether the velocity is part of the state
+		 * @return StateTable::Grid
+		 */
+		static StateTable::Grid getCaptureFrameGrid(bool includeVelocity = true);
 
 };
 
@@ -0,0 +1,132 @@
+/*
+ * VecSimulation.cpp
+ *
+ * Steps several simulations in lockstep. The ball and the reward of every simulation are written into one
+ * contiguous array per value (structure of arrays), so they can be processed in batches without building a State
+ */
+
+#include <Box2D/Box2D.h>
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include "VecSimulation.h"
+#include "Simulation.h"
+#include "../agent/State.h"
+#include "../action/Action.h"
+#include "../action/ActionsSim.cpp"
+
+const int VecSimulation::HOLD_ACTION		= -1;
+
+VecSimulation::VecSimulation(int count, bool randomKickerForce, uint64_t seed, bool includeVelocity) :
+		includeVelocity(includeVelocity), sims(count), actions(count),
+		positionX(count), positionY(count), velocityX(count), velocityY(count),
+		keys(count), rewards(count, Action::DEFAULT_REWARD), dones(count, 0){
+
+	for(int i=0;i<count;i++){
+		sims[i]		= new Simulation(randomKickerForce, seed, i);
+		actions[i]	= ActionsSim::actionsAvailable(*sims[i]);
+
+		sims[i]->setRoundedVelocity(includeVelocity);
+	}
+
+	gather();
+	computeKeys();
+}
+
+VecSimulation::~VecSimulation(){
+	for(int i=0;i<sims.size();i++){
+		for(int j=0;j<actions[i].size();j++){
+			delete actions[i][j];
+		}
+
+		delete sims[i];
+	}
+}
+
+void VecSimulation::step(const int *actionIndices, float32 timeStep){
+	for(int i=0;i<sims.size();i++){
+		if(actionIndices[i] != HOLD_ACTION){
+			actions[i][actionIndices[i]]->run();
+		}
+
+		sims[i]->step(timeStep);
+
+		rewards[i]	= sims[i]->reward;
+		dones[i]	= sims[i]->reward == Action::MIN_REWARD;
+	}
+
+	gather();
+	computeKeys();
+}
+
+void VecSimulation::gather(){
+	for(int i=0;i<sims.size();i++){
+		const b2Vec2 &position	= sims[i]->getBallPosition();
+		const b2Vec2 &velocity	= sims[i]->getBallVelocity();
+
+		positionX[i]			= position.x;
+		positionY[i]			= position.y;
+		velocityX[i]			= includeVelocity ? velocity.x : 0.0f;
+		velocityY[i]			= includeVelocity ? velocity.y : 0.0f;
+	}
+}
+
+void VecSimulation::computeKeys(){
+	const float		max			= State::MAX_ROUNDED_VALUE;
+	const size_t	count		= sims.size();
+
+	//the same rounding as State::roundPos() and State::roundVel(), without a call per value so it can be vectorized
+	for(size_t i=0;i<count;i++){
+		int px		= (int) std::round((positionX[i] > max ? 0.0f : positionX[i]) * 100);
+		int py		= (int) std::round((positionY[i] > max ? 0.0f : positionY[i]) * 100);
+		int vx		= (int) std::round((velocityX[i] > max ? 0.0f : velocityX[i]) * 10);
+		int vy		= (int) std::round((velocityY[i] > max ? 0.0f : velocityY[i]) * 10);
+
+		keys[i]		= ((uint64_t)(uint16_t) px << 48)
+					| ((uint64_t)(uint16_t) py << 32)
+					| ((uint64_t)(uint16_t) vx << 16)
+					| ((uint64_t)(uint16_t) vy);
+	}
+}
+
+int VecSimulation::size() const{
+	return sims.size();
+}
+
+int VecSimulation::getActionCount() const{
+	return actions.empty() ? 0 : actions[0].size();
+}
+
+Simulation& VecSimulation::getSimulation(int index){
+	return *sims[index];
+}
+
+const float* VecSimulation::getPositionX() const{
+	return positionX.data();
+}
+
+const float* VecSimulation::getPositionY() const{
+	return positionY.data();
+}
+
+const float* VecSimulation::getVelocityX() const{
+	return velocityX.data();
+}
+
+const float* VecSimulation::getVelocityY() const{
+	return velocityY.data();
+}
+
+const uint64_t* VecSimulation::getKeys() const{
+	return keys.data();
+}
+
+const float* VecSimulation::getRewards() const{
+	return rewards.data();
+}
+
+const uint8_t* VecSimulation::getDones() const{
+	return dones.data();
+}
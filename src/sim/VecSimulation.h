@@ -0,0 +1,118 @@
+/*
+ * VecSimulation.h
+ *
+ * Steps several simulations in lockstep. The ball and the reward of every simulation are written into one
+ * contiguous array per value (structure of arrays), so they can be processed in batches without building a State
+ */
+
+#ifndef SIM_VECSIMULATION_H_
+#define SIM_VECSIMULATION_H_
+
+#include <Box2D/Box2D.h>
+
+#include <vector>
+#include <cstdint>
+
+#include "../agent/Seeds.h"
+#include "../action/Action.h"
+
+#include "Simulation.h"
+
+class VecSimulation{
+
+	public:
+
+		//the action index that keeps the last action
+		static const int						HOLD_ACTION;
+
+	private:
+
+		const bool								includeVelocity;
+
+		std::vector<Simulation*>				sims;
+
+		//the actions of every simulation, in the order of ActionsSim::actionsAvailable()
+		std::vector<std::vector<Action*>>		actions;
+
+		//one entry per simulation
+		std::vector<float>						positionX;
+		std::vector<float>						positionY;
+		std::vector<float>						velocityX;
+		std::vector<float>						velocityY;
+		std::vector<uint64_t>					keys;
+		std::vector<float>						rewards;
+		std::vector<uint8_t>					dones;
+
+		/**
+		 * Copies the balls of all simulations into the buffers
+		 * @return				void
+		 */
+		void gather();
+
+		/**
+		 * Computes the keys of all simulations from the buffers, equal to State::getKey() of the rounded state
+		 * @return				void
+		 */
+		void computeKeys();
+
+	public:
+
+		/**
+		 * Inits the simulations, simulation i draws from the streams of worker i
+		 * @param	count				int			The amount of simulations
+		 * @param	randomKickerForce	bool		Whether the kicker applies a random force
+		 * @param	seed				uint64_t	The seed of the run, see Seeds
+		 * @param	includeVelocity		bool		Whether the keys include the velocity, see Simulation::setRoundedVelocity()
+		 */
+		VecSimulation(int count, bool randomKickerForce, uint64_t seed = Seeds::fromClock(), bool includeVelocity = true);
+
+		/**
+		 * Frees the simulations and their actions
+		 */
+		~VecSimulation();
+
+		VecSimulation(const VecSimulation&)				= delete;
+		VecSimulation& operator=(const VecSimulation&)	= delete;
+
+		/**
+		 * Runs one action per simulation, steps all of them and fills the buffers.
+		 * A simulation that is done respawned its ball already, the buffers hold the respawned one
+		 * @param	actionIndices		int*		size() indices into the available actions or HOLD_ACTION
+		 * @param	timeStep			float32		The amount of time to step
+		 * @return						void
+		 */
+		void step(const int *actionIndices, float32 timeStep);
+
+		/**
+		 * Returns the amount of simulations
+		 * @return				int
+		 */
+		int size() const;
+
+		/**
+		 * Returns the amount of actions every simulation has
+		 * @return				int
+		 */
+		int getActionCount() const;
+
+		/**
+		 * Returns a simulation, e.g. to render it
+		 * @param	index		int			The simulation
+		 * @return				Simulation&
+		 */
+		Simulation& getSimulation(int index);
+
+		/**
+		 * The buffers after the last step, size() entries each. A done flag is set if the game was over
+		 * @return				const T*
+		 */
+		const float* getPositionX() const;
+		const float* getPositionY() const;
+		const float* getVelocityX() const;
+		const float* getVelocityY() const;
+		const uint64_t* getKeys() const;
+		const float* getRewards() const;
+		const uint8_t* getDones() const;
+};
+
+#endif /* SIM_VECSIMULATION_H_ */
@@ -0,0 +1,137 @@
+/*
+ * AllocationCounter.cpp
+ *
+ * Counts the heap allocations made through the global operator new, including the aligned overloads
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+//zero-initialized, so no dynamic thread local initialization is needed inside of operator new
+static thread_local unsigned long long allocations = 0;
+
+unsigned long long AllocationCounter::getAllocations(){
+	return allocations;
+}
+
+static void* countedAllocation(std::size_t size){
+	allocations++;
+
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+static void* countedAllocation(std::size_t size, std::align_val_t alignment){
+	std::size_t align = static_cast<std::size_t>(alignment);
+
+	allocations++;
+
+	//aligned_alloc wants a multiple of the alignment
+	return std::aligned_alloc(align, size == 0 ? align : (size + align - 1) / align * align);
+}
+
+void* operator new(std::size_t size){
+	void *p = countedAllocation(size);
+
+	if(!p){
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[](std::size_t size){
+	void *p = countedAllocation(size);
+
+	if(!p){
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept{
+	return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept{
+	return countedAllocation(size);
+}
+
+//used for over-aligned types, e.g. the alignas(64) shards, row locks and reader slots of the state table
+void* operator new(std::size_t size, std::align_val_t alignment){
+	void *p = countedAllocation(size, alignment);
+
+	if(!p){
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment){
+	void *p = countedAllocation(size, alignment);
+
+	if(!p){
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+	return countedAllocation(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+	return countedAllocation(size, alignment);
+}
+
+void operator delete(void *p) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept{
+	std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept{
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept{
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept{
+	std::free(p);
+}
@@ -0,0 +1,25 @@
+/*
+ * AllocationCounter.h
+ *
+ * Counts the heap allocations made through the global operator new, including the aligned overloads
+ */
+
+#ifndef STATS_ALLOCATIONCOUNTER_H_
+#define STATS_ALLOCATIONCOUNTER_H_
+
+/*
+ * The counter is per thread, so background threads don't show up in the numbers of the simulation loop.
+ * AllocationCounter.cpp replaces the global operator new/delete, the aligned overloads included, linking it is enough to enable the counting
+ */
+class AllocationCounter{
+
+	public:
+
+		/**
+		 * Returns the amount of allocations made by the calling thread since it started
+		 * @return		unsigned long long
+		 */
+		static unsigned long long getAllocations();
+};
+
+#endif /* STATS_ALLOCATIONCOUNTER_H_ */
@@ -0,0 +1,132 @@
+/*
+ * PhaseProfiler.cpp
+ *
+ * Measures how long the phases of a step take, see PhaseProfiler.h
+ */
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "PhaseProfiler.h"
+
+const char* const PhaseProfiler::PHASE_NAMES[PhaseProfiler::PHASE_COUNT] = {
+	"WORLD_STEP",
+	"CONTACTS",
+	"STATE",
+	"THINK",
+	"RENDER",
+	"STATS_LOG",
+	"POLICY_SAVE"
+};
+
+const int PhaseProfiler::BUCKET_COUNT		= 16 + 60 * 8; //up to 2^64ns
+
+#ifndef PINBALLBOT_NO_PROFILER
+
+PhaseProfiler::Timer::Timer(PhaseProfiler *profiler, Phase phase) :
+		profiler(profiler), phase(phase){
+
+	if(profiler != nullptr){
+		started = std::chrono::steady_clock::now();
+	}
+}
+
+PhaseProfiler::Timer::~Timer(){
+	if(profiler != nullptr){
+		profiler->record(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+	}
+}
+
+PhaseProfiler::PhaseProfiler() :
+		counts(PHASE_COUNT * BUCKET_COUNT), maxima(PHASE_COUNT), summarized(PHASE_COUNT * BUCKET_COUNT, 0){
+}
+
+int PhaseProfiler::getBucket(uint64_t nanoseconds){
+	if(nanoseconds < 16){
+		return nanoseconds;
+	}
+
+	//the highest bit picks the power of two, the three bits below it the bucket within it
+	int exponent = 63 - __builtin_clzll(nanoseconds);
+
+	return 16 + (exponent - 4) * 8 + ((nanoseconds >> (exponent - 3)) & 7);
+}
+
+double PhaseProfiler::getBucketValue(int bucket){
+	if(bucket < 16){
+		return bucket;
+	}
+
+	int exponent	= (bucket - 16) / 8 + 4;
+	double width	= std::ldexp(1.0, exponent - 3);
+
+	return (8 + (bucket - 16) % 8) * width + width / 2;
+}
+
+void PhaseProfiler::record(Phase phase, uint64_t nanoseconds){
+	std::atomic<uint64_t> &count = counts[phase * BUCKET_COUNT + getBucket(nanoseconds)];
+
+	//only one thread records, so there's no need for a locked add
+	count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	//the summary resets the maximum concurrently
+	uint64_t max = maxima[phase].load(std::memory_order_relaxed);
+
+	while(nanoseconds > max && !maxima[phase].compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)){
+	}
+}
+
+PhaseProfiler::Summary PhaseProfiler::summarize(const std::vector<PhaseProfiler*> &profilers, Phase phase){
+	std::vector<uint64_t>	histogram(BUCKET_COUNT, 0);
+	Summary					summary		= {0, 0, 0, 0};
+	uint64_t				max			= 0;
+
+	for(size_t p=0;p<profilers.size();p++){
+		PhaseProfiler *profiler = profilers[p];
+
+		for(int b=0;b<BUCKET_COUNT;b++){
+			uint64_t count		= profiler->counts[phase * BUCKET_COUNT + b].load(std::memory_order_relaxed);
+			uint64_t &last		= profiler->summarized[phase * BUCKET_COUNT + b];
+
+			histogram[b]		+= count - last;
+			summary.count		+= count - last;
+			last				= count;
+		}
+
+		max = std::max(max, profiler->maxima[phase].exchange(0, std::memory_order_relaxed));
+	}
+
+	if(summary.count == 0){
+		return summary;
+	}
+
+	//the first bucket that reaches the rank of the percentile, a maximum of 0 was reset before its duration was recorded
+	unsigned long long	rank50		= (summary.count + 1) / 2;
+	unsigned long long	rank99		= summary.count - summary.count / 100;
+	unsigned long long	seen		= 0;
+	bool				found50		= false;
+
+	for(int b=0;b<BUCKET_COUNT;b++){
+		seen += histogram[b];
+
+		if(!found50 && seen >= rank50){
+			summary.p50	= (max == 0 ? getBucketValue(b) : std::min(getBucketValue(b), (double) max)) / 1000.0;
+			found50		= true;
+		}
+
+		if(seen >= rank99){
+			summary.p99	= (max == 0 ? getBucketValue(b) : std::min(getBucketValue(b), (double) max)) / 1000.0;
+			break;
+		}
+	}
+
+	summary.max = max / 1000.0;
+
+	return summary;
+}
+
+#endif
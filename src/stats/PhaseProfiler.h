@@ -0,0 +1,143 @@
+/*
+ * PhaseProfiler.h
+ *
+ * Measures how long the phases of a step take. Every phase feeds a histogram with buckets that grow
+ * exponentially (8 per power of two, so a percentile is off by at most 12.5%), recording a duration is
+ * a clock read and one relaxed atomic add.
+ *
+ * Defining PINBALLBOT_NO_PROFILER replaces the profiler with an empty one, nothing is measured and
+ * no columns are logged
+ */
+
+#ifndef STATS_PHASEPROFILER_H_
+#define STATS_PHASEPROFILER_H_
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class PhaseProfiler{
+
+	public:
+
+		/**
+		 * The phases that are measured
+		 */
+		enum Phase{
+			WORLD_STEP,		//world.Step(), including the contacts
+			CONTACTS,		//the contact callbacks
+			STATE,			//rounding the state after a step
+			THINK,			//Agent::think()
+			RENDER,			//drawing a frame
+			STATS_LOG,		//writing a row of the stats
+			POLICY_SAVE,	//Agent::savePoliciesToFile(), only the part the caller waits for
+			PHASE_COUNT
+		};
+
+		static const char* const			PHASE_NAMES[PHASE_COUNT];
+
+		//the buckets below 16ns hold one nanosecond each, then 8 per power of two
+		static const int					BUCKET_COUNT;
+
+		/**
+		 * The durations recorded since the last summary, in microseconds
+		 */
+		struct Summary{
+			unsigned long long				count;
+			double							p50;
+			double							p99;
+			double							max;
+		};
+
+#ifndef PINBALLBOT_NO_PROFILER
+		/**
+		 * Records the time until it goes out of scope
+		 */
+		class Timer{
+
+			private:
+
+				PhaseProfiler								*profiler;
+				Phase										phase;
+				std::chrono::steady_clock::time_point		started;
+
+			public:
+
+				/**
+				 * Starts measuring
+				 * @param	profiler	PhaseProfiler*	The profiler to record to, nullptr to measure nothing
+				 * @param	phase		Phase			The phase
+				 */
+				Timer(PhaseProfiler *profiler, Phase phase);
+
+				/**
+				 * Records the time since the construction
+				 */
+				~Timer();
+		};
+
+	private:
+
+		//PHASE_COUNT rows of BUCKET_COUNT counts, only ever increased
+		std::vector<std::atomic<uint64_t>>	counts;
+
+		//in nanoseconds, reset by every summary
+		std::vector<std::atomic<uint64_t>>	maxima;
+
+		//the counts at the last summary, only touched by the thread summarizing
+		std::vector<uint64_t>				summarized;
+
+		/**
+		 * Returns the bucket of a duration
+		 * @param	nanoseconds		uint64_t
+		 * @return					int
+		 */
+		static int getBucket(uint64_t nanoseconds);
+
+		/**
+		 * Returns the duration in the middle of a bucket
+		 * @param	bucket			int
+		 * @return					double		In nanoseconds
+		 */
+		static double getBucketValue(int bucket);
+
+	public:
+
+		/**
+		 * Inits an empty profiler
+		 */
+		PhaseProfiler();
+
+		/**
+		 * Records a duration, may be called by one thread at a time
+		 * @param	phase			Phase		The phase
+		 * @param	nanoseconds		uint64_t	The duration
+		 * @return					void
+		 */
+		void record(Phase phase, uint64_t nanoseconds);
+
+		/**
+		 * Summarizes the durations of a phase all profilers recorded since the last summary. Safe to call while they record
+		 * @param	profilers		std::vector<PhaseProfiler*>		The profilers, e.g. one per worker
+		 * @param	phase			Phase							The phase
+		 * @return					Summary
+		 */
+		static Summary summarize(const std::vector<PhaseProfiler*> &profilers, Phase phase);
+#else
+		class Timer{
+
+			public:
+
+				Timer(PhaseProfiler *profiler, Phase phase){}
+		};
+
+		void record(Phase phase, uint64_t nanoseconds){}
+
+		static Summary summarize(const std::vector<PhaseProfiler*> &profilers, Phase phase){
+			return Summary{0, 0, 0, 0};
+		}
+#endif
+};
+
+#endif /* STATS_PHASEPROFILER_H_ */